@@ -27,25 +27,39 @@ public:
 
     virtual void save();
 
+    void unpin();
+
+    bool is_pinned() const { return this->block != nullptr; }
+
     BlockID get_id() const { return this->id; }
 
 protected:
-    SlottedPage *block;
+    mutable SlottedPage *block;  // nullptr while unpinned
     HeapFile &file;
     BlockID id;
     const KeyProfile &key_profile;
 
+    SlottedPage *page() const;
+
     static Dbt *marshal_block_id(BlockID block_id);
 
     static Dbt *marshal_handle(Handle handle);
 
     virtual Dbt *marshal_key(const KeyValue *key);
 
+    virtual Dbt *marshal_key(const Value *key);
+
     virtual BlockID get_block_id(RecordID record_id) const;
 
     virtual Handle get_handle(RecordID record_id) const;
 
     virtual KeyValue *get_key(RecordID record_id) const;
+
+    virtual void get_key(RecordID record_id, Value *key) const;
+
+    void unmarshal_key(const char *bytes, Value *key) const;
+
+    bool fill(Dbt *first, Dbt *second, uint32_t limit);
 };
 
 class BTreeStat : public BTreeNode {
@@ -81,20 +95,30 @@ public:
 
     virtual ~BTreeInterior();
 
-    BTreeNode *find(const KeyValue *key, uint depth) const;
+    BlockID find(const KeyValue *key) const;
+
+    size_t child_index(const KeyValue *key) const;
 
     Insertion insert(const KeyValue *boundary, BlockID block_id);
 
+    bool append(const KeyValue *boundary, BlockID block_id, uint32_t limit);
+
     virtual void save();
 
     void set_first(BlockID first) { this->first = first; }
 
+    BlockID get_first() const { return this->first; }
+
     friend std::ostream &operator<<(std::ostream &out, const BTreeInterior &node);
 
 protected:
     BlockID first;
     BlockPointers pointers;
-    KeyValues boundaries;
+    std::vector<Value> boundaries;  // all the boundary keys in one array, key_profile.size() values each
+
+    const Value *boundary(size_t i) const { return &this->boundaries[i * this->key_profile.size()]; }
+
+    bool not_above(size_t i, const KeyValue *key) const;
 };
 
 class BTreeLeaf : public BTreeNode {
@@ -106,11 +130,42 @@ public:
     Handle find_eq(const KeyValue *key) const;  // throws if not found
     Insertion insert(const KeyValue *key, Handle handle);
 
-    virtual void save();
+    bool del(const KeyValue *key);
+
+    bool append(const KeyValue *key, Handle handle, uint32_t limit);
+
+    uint size() const;
+
+    uint lower_bound(const KeyValue *key) const;
+
+    int compare_at(uint at, const KeyValue *key) const { return compare(entry(at), key); }
+
+    KeyValue *get_key_at(uint at) const;
+
+    Handle get_handle_at(uint at) const;
+
+    BlockID get_next_leaf() const;
+
+    void set_next_leaf(BlockID next_leaf);
 
 protected:
-    BlockID next_leaf;
-    std::map<KeyValue, Handle> key_map;
-};
+    /*
+     * The block holds the directory as record 1: the id of the next leaf, then the record ids of the entries
+     * in key order. Each entry is a record of its own: the handle, then the marshaled key.
+     */
+    static const RecordID DIRECTORY = 1;
+    static const uint HANDLE_SZ = sizeof(BlockID) + sizeof(RecordID);
+
+    RecordID entry_id(uint at) const;
+
+    const char *entry(uint at) const;
+
+    int compare(const char *bytes, const KeyValue *key) const;
 
+    Dbt *marshal_entry(const KeyValue *key, Handle handle);
+
+    void add_entry(uint at, const Dbt *entry);
+
+    void put_directory(BlockID next_leaf, const RecordID *ids, uint count);
+};
 
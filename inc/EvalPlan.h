@@ -14,21 +14,23 @@ typedef std::pair<DbRelation *, Handles *> EvalPipeline;
 class EvalPlan {
 public:
     enum PlanType {
-        ProjectAll, Project, Select, TableScan
+        ProjectAll, Project, Select, TableScan, IndexScan, BitmapHeapScan
     };
 
-    EvalPlan(PlanType type, EvalPlan *relation);  // use for ProjectAll, e.g., EvalPlan(EvalPlan::ProjectAll, table);
+    EvalPlan(PlanType type, EvalPlan *relation);  // use for ProjectAll or BitmapHeapScan, e.g., EvalPlan(EvalPlan::ProjectAll, table);
     EvalPlan(ColumnNames *projection, EvalPlan *relation); // use for Project
     EvalPlan(ValueDict *conjunction, EvalPlan *relation);  // use for Select
     EvalPlan(DbRelation &table);  // use for TableScan
+    EvalPlan(DbIndex &index, ValueDict *key);  // use for IndexScan of one key
+    EvalPlan(DbIndex &index, ValueDict *min_key, ValueDict *max_key);  // use for IndexScan of a range of keys
     EvalPlan(const EvalPlan *other);  // use for copying
     virtual ~EvalPlan();
 
     // Attempt to get the best equivalent evaluation plan
     EvalPlan *optimize();
 
-    // Evaluate the plan: evaluate gets values, pipeline gets handles
-    ValueDicts *evaluate();
+    // Evaluate the plan: evaluate gets values (allocated in arena, if given), pipeline gets handles
+    RowSet *evaluate(Arena *arena = nullptr);
 
     EvalPipeline pipeline();
 
@@ -38,7 +40,10 @@ protected:
     EvalPlan *relation;  // for everything except TableScan
     ColumnNames *projection;  // for Project
     ValueDict *select_conjunction;  // for Select
-    DbRelation &table;  // for TableScan
+    DbRelation &table;  // for TableScan and IndexScan
+    DbIndex *index;  // for IndexScan
+    ValueDict *min_key;  // for IndexScan (the key, if it's a lookup)
+    ValueDict *max_key;  // for IndexScan of a range
 };
 
 
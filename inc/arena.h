@@ -0,0 +1,75 @@
+/**
+ * @file arena.h - Bump allocator for memory that lives as long as one statement.
+ * Arena
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * @class Arena - hands out memory by bumping a pointer through big chunks, all freed at once
+ *
+ * Nothing is freed on its own; everything goes when the arena is deleted. Destructors are not run,
+ * so only put things here that don't need them (or run them yourself, as RowSet does for its Values).
+ * Spent chunks go onto a shared list for the next arena to reuse, so a steady stream of statements
+ * doesn't go back to the system allocator for them. Allocations too big for a chunk get their own
+ * block, which is just freed.
+ *
+ * An arena is not itself safe to share between threads, but any number of arenas can come and go
+ * on different threads.
+ */
+class Arena {
+public:
+    static const size_t CHUNK_SZ = 64 * 1024;
+    static const size_t MAX_FREE_CHUNKS = 64;  // most spent chunks kept for reuse
+
+    Arena() : next(nullptr), end(nullptr), size(0) {}
+
+    virtual ~Arena();
+
+    Arena(const Arena &other) = delete;
+
+    Arena(Arena &&temp) = delete;
+
+    Arena &operator=(const Arena &other) = delete;
+
+    Arena &operator=(Arena &&temp) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    char *copy(const char *data, size_t size);
+
+    /**
+     * Room for n T's, constructed with their default constructor.
+     * @param n  how many
+     * @returns  the first of them
+     */
+    template<typename T>
+    T *make_array(size_t n) {
+        T *array = static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < n; i++)
+            new(array + i) T();
+        return array;
+    }
+
+    /**
+     * @returns  number of bytes handed out so far
+     */
+    size_t get_size() const { return size; }
+
+protected:
+    char *next;                 // start of the unused part of the current chunk
+    char *end;                  // end of the current chunk
+    size_t size;
+    std::vector<char *> chunks; // CHUNK_SZ chunks we got, to go back on the free list
+    std::vector<char *> big;    // allocations that got a block of their own
+
+    static std::mutex free_latch;
+
+    static std::vector<char *> &free_chunks();
+};
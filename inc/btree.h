@@ -6,11 +6,20 @@
  */
 #pragma once
 
+#include <list>
+#include <unordered_map>
 #include "BTreeNode.h"
 
+typedef std::vector<std::pair<KeyValue, Handle>> IndexEntries;
+
+class BTreeCursor;
+
 class BTreeIndex : public DbIndex {
 public:
-    BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique);
+    static const uint FILL_PERCENT = 90;  // how full create() packs the nodes, by default
+
+    BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique,
+               uint block_size = DbBlock::BLOCK_SZ, uint fill_percent = FILL_PERCENT);
 
     virtual ~BTreeIndex();
 
@@ -26,27 +35,86 @@ public:
 
     virtual Handles *range(ValueDict *min_key, ValueDict *max_key) const;
 
+    BTreeCursor cursor(const ValueDict *min_key, bool min_inclusive, const ValueDict *max_key,
+                       bool max_inclusive) const;
+
     virtual void insert(Handle handle);
 
+    virtual void insert_batch(const Handles *handles);
+
     virtual void del(Handle handle);
 
     virtual KeyValue *tkey(const ValueDict *key) const; // pull out the key values from the ValueDict in order
 
+    friend class BTreeCursor;
+
 protected:
     static const BlockID STAT = 1;
+    static const uint CACHED_LEAVES = 64;  // most leaves kept decoded
     bool closed;
     BTreeStat *stat;
-    BTreeNode *root;
     HeapFile file;
     KeyProfile key_profile;
+    uint fill_percent;
+    mutable std::unordered_map<BlockID, BTreeNode *> resident;  // decoded root and interior nodes
+    mutable std::list<BTreeLeaf *> leaves;  // decoded leaves, most recently used first
+    mutable std::unordered_map<BlockID, std::list<BTreeLeaf *>::iterator> leaf_index;  // where each is in leaves
 
     void build_key_profile();
 
+    BTreeNode *node(BlockID block_id, uint height) const;
+
+    BTreeLeaf *cache_leaf(BTreeLeaf *leaf) const;
+
+    BTreeLeaf *find_leaf(const KeyValue *key) const;
+
+    void uncache();
+
+    IndexEntries *sorted_entries(const Handles *handles) const;
+
+    void bulk_load(const IndexEntries *entries);
+
     Handles *_lookup(BTreeNode *node, uint height, const KeyValue *key) const;
 
+    void insert_key(const KeyValue *key, Handle handle);
+
     Insertion _insert(BTreeNode *node, uint height, const KeyValue *key, Handle handle);
 };
 
+/**
+ * @class BTreeCursor - streams the handles of a range of a BTreeIndex, in key order
+ *
+ * Got from BTreeIndex::cursor(), which has already found the first entry in the range. From there the cursor
+ * walks the leaf and then follows the chain of next leaf pointers, getting each leaf from the index only when
+ * it reaches it, and stops at the upper bound. All it keeps is its place (a leaf and an entry in it) and the
+ * upper bound. Changing the index while a cursor is open invalidates the cursor.
+ */
+class BTreeCursor {
+public:
+    BTreeCursor(const BTreeIndex &index, BlockID leaf_id, uint at, const KeyValue *max_key, bool max_inclusive);
+
+    /**
+     * @returns  true if there are no more entries in the range
+     */
+    bool at_end() const { return leaf_id == 0; }
+
+    Handle next();
+
+protected:
+    const BTreeIndex &index;
+    BlockID leaf_id;  // 0 once past the end
+    uint at;          // entry within the leaf
+    KeyValue max_key;
+    bool bounded;     // false for no upper bound
+    bool max_inclusive;
+
+    BTreeLeaf *leaf() const;
+
+    void settle();
+};
+
 bool test_btree();
 
+bool benchmark_btree();
+
 
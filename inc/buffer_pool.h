@@ -0,0 +1,132 @@
+/**
+ * @file buffer_pool.h - Buffer pool sitting between the heap storage engine and its Berkeley DB files.
+ * BufferPool
+ * PinnedPage: SlottedPage
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "db_cxx.h"
+#include "slotted_page.h"
+
+/**
+ * @class BufferPoolError - exception for BufferPool methods
+ * A DbRelationError, so that running out of frames fails the statement rather than the shell.
+ */
+class BufferPoolError : public DbRelationError {
+public:
+    explicit BufferPoolError(std::string s) : DbRelationError(s) {}
+};
+
+/**
+ * @class BufferPool - a fixed number of in-memory frames caching the blocks of one Berkeley DB RecNo file.
+ *
+ * A block is pinned while someone is using it and can only be evicted once it is unpinned. Changed
+ * blocks are just marked dirty; they are written back when their frame is reused or the pool is
+ * flushed. Victims are chosen with the CLOCK (second chance) policy.
+ *
+ * Blocks can also be asked for ahead of time with read_ahead(); a background thread then reads them
+ * into unpinned frames while the caller works on other blocks. The pool is safe to share between
+ * threads; a pin() of a block that is still being read waits for it.
+ */
+class BufferPool {
+public:
+    static const uint DEFAULT_FRAMES = 256;
+
+    BufferPool(Db &db, uint block_size, uint frame_count = DEFAULT_FRAMES);
+
+    virtual ~BufferPool();
+
+    BufferPool(const BufferPool &other) = delete;
+
+    BufferPool(BufferPool &&temp) = delete;
+
+    BufferPool &operator=(const BufferPool &other) = delete;
+
+    BufferPool &operator=(BufferPool &&temp) = delete;
+
+    char *pin(BlockID block_id);
+
+    char *pin_new(BlockID block_id);
+
+    void unpin(BlockID block_id);
+
+    void put(BlockID block_id, const void *data);
+
+    void read_ahead(const BlockID *block_ids, uint count);
+
+    void flush();
+
+    static void flush_all();
+
+protected:
+    struct Frame {
+        BlockID block_id;  // 0 if the frame is empty
+        uint pin_count;
+        bool dirty;
+        bool referenced;   // second chance bit for CLOCK
+        bool loading;      // being read in (by whoever claimed the frame, with the latch released)
+    };
+
+    Db &db;
+    uint block_size;
+    char *memory;
+    std::vector<Frame> frames;
+    std::unordered_map<BlockID, uint> page_table;  // block id -> frame number
+    uint hand;
+    std::mutex latch;                       // guards everything above (but not the frames' bytes)
+    std::condition_variable loaded;         // a frame finished loading
+    std::deque<BlockID> requests;           // blocks waiting for the read-ahead thread
+    std::condition_variable requested;
+    std::thread *loader;                    // read-ahead thread, started on first use
+    bool stopping;
+
+    static const uint NO_FRAME = UINT32_MAX;
+
+    uint lookup(std::unique_lock<std::mutex> &lock, BlockID block_id);
+
+    uint victim();
+
+    char *address(uint frame) const { return memory + (size_t) frame * block_size; }
+
+    bool load(std::unique_lock<std::mutex> &lock, uint frame, BlockID block_id);
+
+    void unload(uint frame, BlockID block_id);
+
+    void load_requests();
+
+    bool read(uint frame, BlockID block_id);
+
+    void write(uint frame);
+
+    static std::set<BufferPool *> &pools();
+};
+
+/**
+ * @class PinnedPage - a SlottedPage whose block lives in a BufferPool frame; unpins it when deleted.
+ */
+class PinnedPage : public SlottedPage {
+public:
+    PinnedPage(BufferPool &pool, Dbt &block, BlockID block_id, bool is_new = false);
+
+    virtual ~PinnedPage();
+
+    PinnedPage(const PinnedPage &other) = delete;
+
+    PinnedPage(PinnedPage &&temp) = delete;
+
+    PinnedPage &operator=(const PinnedPage &other) = delete;
+
+    PinnedPage &operator=(PinnedPage &&temp) = delete;
+
+protected:
+    BufferPool &pool;
+};
@@ -0,0 +1,76 @@
+/**
+ * @file free_space_map.h - Persistent record of roughly how much room each block of a heap file has.
+ * FreeSpaceMap
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include <vector>
+#include "db_cxx.h"
+#include "buffer_pool.h"
+
+/**
+ * @class FreeSpaceMap - free space per block of a heap file, for finding a block to insert into
+ *
+ * Each block's free space is kept as a one-byte category: free bytes in units of 1/256 of the block
+ * size, rounded down, so a block is never reported to have more room than it does. The categories
+ * are also kept in a max-tree so that the first block with at least a given amount of room is found
+ * in O(log n).
+ *
+ * The map is stored in its own Berkeley DB RecNo file, <name>.fsm.db, cached in a small BufferPool:
+ * record 1 holds the number of blocks covered and the following records hold PAGE_SZ categories each.
+ * It can lag behind the heap file (the owner catches it up when opening); being approximate is fine
+ * since the block itself has the final say on whether a record fits.
+ */
+class FreeSpaceMap {
+public:
+    static const uint PAGE_SZ = 4096;
+
+    FreeSpaceMap(std::string name);
+
+    virtual ~FreeSpaceMap();
+
+    FreeSpaceMap(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap(FreeSpaceMap &&temp) = delete;
+
+    FreeSpaceMap &operator=(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap &operator=(FreeSpaceMap &&temp) = delete;
+
+    virtual void create(uint block_size);
+
+    virtual void drop();
+
+    virtual void open(uint block_size);
+
+    virtual void close();
+
+    virtual void update(BlockID block_id, uint32_t free_bytes);
+
+    virtual BlockID find(uint32_t bytes) const;
+
+    /**
+     * Get the number of blocks the map has an entry for.
+     * @return blocks 1..n are covered
+     */
+    BlockID get_block_count() const { return block_count; }
+
+protected:
+    std::string dbfilename;
+    uint unit;             // bytes per category step
+    BlockID block_count;
+    std::vector<uint8_t> tree;  // max-tree: node i has children 2i and 2i+1, leaf for block b at leaves + b - 1
+    uint leaves;
+    Db *db;
+    BufferPool *pool;
+
+    void db_open(uint block_size, uint flags);
+
+    void grow(BlockID block_id);
+
+    void resize(BlockID block_id);
+
+    void set(BlockID block_id, uint8_t category);
+};
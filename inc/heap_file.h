@@ -9,21 +9,34 @@
 
 #include "db_cxx.h"
 #include "slotted_page.h"
+#include "buffer_pool.h"
+#include "free_space_map.h"
 
 
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one of our
-        database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
-        for buffer management and file management.
+        database blocks for each Berkeley DB record in the RecNo file. Berkeley DB does the file management;
+        blocks are cached in our own BufferPool, so get() hands out a page pinned in a pool frame (deleting
+        the page unpins it) and put() only marks the frame dirty until it is evicted or the file is closed.
+        A FreeSpaceMap kept alongside (updated by get_new() and put()) finds blocks with room for inserts.
+        New blocks are allocated in extents: a run of empty blocks formatted in memory and written with
+        one bulk put, which get_new() then hands out one at a time without any further I/O. Extents
+        start at one block and double with the file up to EXTENT_PAGES. Unused blocks of the last extent
+        are just empty blocks once the file is reopened.
         Uses SlottedPage for storing records within blocks.
+        The block size is chosen when the file is created and is kept by Berkeley DB as the RecNo
+        record length, so an existing file is always reopened with the block size it was created with.
  */
 class HeapFile : public DbFile {
 public:
-    HeapFile(std::string name);
+    static const uint EXTENT_PAGES = 64;
+    static const uint MAX_EXTENT_BYTES = 4 * 1024 * 1024;
 
-    virtual ~HeapFile() {}
+    HeapFile(std::string name, uint block_size = DbBlock::BLOCK_SZ, uint frame_count = BufferPool::DEFAULT_FRAMES);
+
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile &other) = delete;
 
@@ -41,13 +54,19 @@ public:
 
     virtual void close(void);
 
+    virtual void flush(void);
+
     virtual SlottedPage *get_new(void);
 
     virtual SlottedPage *get(BlockID block_id);
 
     virtual void put(DbBlock *block);
 
-    virtual BlockIDs *block_ids() const;
+    virtual BlockCursor block_cursor(BlockID start = 1, BlockID end = UINT32_MAX) const;
+
+    virtual void prefetch(const BlockID *block_ids, uint count);
+
+    virtual BlockID find_room(uint32_t record_size) const;
 
     /**
      * Get the id of the current final block in the heap file.
@@ -55,13 +74,32 @@ public:
      */
     virtual uint32_t get_last_block_id() { return last; }
 
+    /**
+     * Get the size of the blocks in this file (only known for sure once the file is open).
+     * @return number of bytes per block
+     */
+    virtual uint get_block_size() const { return block_size; }
+
 protected:
     std::string dbfilename;
+    uint block_size;
+    uint frame_count;
     uint32_t last;
+    uint32_t allocated;  // last block written to the file (from the latest extent)
     bool closed;
     Db db;
+    BufferPool *pool;
+    FreeSpaceMap fsm;
 
     virtual void db_open(uint flags = 0);
 
+    void compact_if_fragmented(DbBlock *block) const;
+
+    void note_free_space(DbBlock *block);
+
+    void fsm_open(bool create);
+
     virtual uint32_t get_block_count();
+
+    virtual void allocate_extent();
 };
\ No newline at end of file
@@ -7,19 +7,41 @@
  */
 #pragma once
 
+#include <chrono>
+#include <set>
 #include "storage_engine.h"
 #include "slotted_page.h"
 #include "heap_file.h"
+#include "mmap_heap_file.h"
+#include "read_ahead.h"
+#include "row_codec.h"
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * Inserts go into a tail page that stays pinned from one insert to the next, so adding a row is just
+ * copying it into the page. The tail page is written back (put into the file) when it fills up,
+ * after a number of rows or an amount of time (see set_tail_flush()), when the table is closed, and at
+ * every flush_all() (which SQLExec does after each statement). Deletes can go to the tail page through
+ * a page of their own, since pages on the same block keep no header state of their own.
  */
 
 class HeapTable : public DbRelation {
 public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    // where the table's blocks are kept (chosen through this API only: tables made with SQL, which are the ones
+    // in the catalog, are always BERKELEY_DB)
+    enum Backend {
+        BERKELEY_DB,  // HeapFile: Berkeley DB RecNo file under our buffer pool
+        MMAP          // MMapHeapFile: memory-mapped file, good for read-mostly tables
+    };
+
+    static const uint TAIL_FLUSH_ROWS = 1000;
+    static const uint TAIL_FLUSH_MS = 1000;
 
-    virtual ~HeapTable() {}
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              uint block_size = DbBlock::BLOCK_SZ, Backend backend = BERKELEY_DB);
+
+    virtual ~HeapTable();
 
     HeapTable(const HeapTable &other) = delete;
 
@@ -41,6 +63,8 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handles *insert_batch(const ValueDicts *rows);
+
     virtual void update(const Handle handle, const ValueDict *new_values);
 
     virtual void del(const Handle handle);
@@ -57,16 +81,48 @@ public:
 
     using DbRelation::project;
 
+    virtual RowSet *project_rows(Handles *handles, const ColumnNames *column_names = nullptr,
+                                 Arena *arena = nullptr);
+
+    virtual void set_tail_flush(uint rows, uint milliseconds);
+
+    static void flush_all();
+
 protected:
-    HeapFile file;
+    HeapFile *file;
+    RowCodec *codec;            // layout of the records, worked out when the file is first open
+    SlottedPage *tail;          // resident page inserts go into (nullptr if none)
+    uint tail_rows;             // rows added to the tail page since it was last written back
+    std::chrono::steady_clock::time_point tail_flushed;
+    uint flush_rows;
+    std::chrono::milliseconds flush_interval;
+
+    virtual void flush_tail();
+
+    virtual void release_tail();
+
+    static std::set<HeapTable *> &tails();
+
+    virtual void compile_codec();
 
     virtual ValueDict *validate(const ValueDict *row) const;
 
     virtual Handle append(const ValueDict *row);
 
+    virtual Handle append(const ValueDict *row, uint32_t size);
+
+    virtual SlottedPage *find_block(uint32_t size);
+
     virtual Dbt *marshal(const ValueDict *row) const;
 
     virtual ValueDict *unmarshal(Dbt *data) const;
 
-    virtual bool selected(Handle handle, const ValueDict *where);
+    virtual ValueDict *unmarshal(const RecordView &record) const;
+
+    // where clause resolved to (column number, value) pairs, sorted by column number
+    typedef std::vector<std::pair<uint, const Value *>> Conjunction;
+
+    virtual bool compile(const ValueDict *where, Conjunction &conjunction) const;
+
+    virtual bool selected(SlottedPage *block, RecordID record_id, const Conjunction &conjunction) const;
 };
@@ -0,0 +1,85 @@
+/**
+ * @file mmap_heap_file.h - Heap file kept in a memory-mapped file instead of Berkeley DB.
+ * MMapHeapFile: HeapFile
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include "heap_file.h"
+
+/**
+ * @class MMapHeapFile - heap file implementation of DbFile on top of mmap(2)
+ *
+ * The relation is a plain file, <name>.mmap in the database environment's home directory, mapped
+ * into memory. Block n lives at offset n * block_size; block 0 is a header holding a magic number,
+ * the block size and the id of the last block. get() hands out SlottedPages that point straight into
+ * the mapping, so there is no copy on either get or put (put only tidies the page). Meant for
+ * read-mostly tables; the pages must be deleted before the file is closed. The free space map is
+ * kept in Berkeley DB just as for HeapFile.
+ *
+ * To keep handed-out pages valid while the file grows, a large range of address space is reserved
+ * when the file is opened and the file is mapped into the front of it, extending the mapping in
+ * place (MAP_FIXED) as blocks are added. While a scan runs, just its blocks are advised MADV_SEQUENTIAL.
+ */
+class MMapHeapFile : public HeapFile {
+public:
+    static const uint32_t MAGIC = 0x48504d4d;  // "MMPH"
+    static const size_t RESERVE_BYTES = (size_t) 16 * 1024 * 1024 * 1024;
+
+    MMapHeapFile(std::string name, uint block_size = DbBlock::BLOCK_SZ);
+
+    virtual ~MMapHeapFile();
+
+    MMapHeapFile(const MMapHeapFile &other) = delete;
+
+    MMapHeapFile(MMapHeapFile &&temp) = delete;
+
+    MMapHeapFile &operator=(const MMapHeapFile &other) = delete;
+
+    MMapHeapFile &operator=(MMapHeapFile &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual void flush(void);
+
+    virtual SlottedPage *get_new(void);
+
+    virtual SlottedPage *get(BlockID block_id);
+
+    virtual void put(DbBlock *block);
+
+    virtual void prefetch(const BlockID *block_ids, uint count);
+
+    virtual void begin_scan(const BlockCursor &cursor);
+
+    virtual void end_scan(const BlockCursor &cursor);
+
+protected:
+    struct Header {
+        uint32_t magic;
+        uint32_t block_size;
+        uint32_t last;
+    };
+
+    std::string path;
+    int fd;
+    char *base;         // start of the reserved address range (block 0)
+    size_t mapped;      // bytes of the file currently mapped (a multiple of the OS page size)
+
+    void mmap_open(bool create);
+
+    void grow(BlockID block_id);
+
+    void advise(const BlockCursor &cursor, int advice) const;
+
+    char *address(BlockID block_id) const { return this->base + (size_t) block_id * this->block_size; }
+
+    Header *header() const { return (Header *) this->base; }
+};
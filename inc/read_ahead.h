@@ -0,0 +1,60 @@
+/**
+ * @file read_ahead.h - Read-ahead for sequential scans of a DbFile.
+ * ReadAhead
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include <chrono>
+#include "storage_engine.h"
+
+/**
+ * @class ReadAhead - gets the blocks of a cursor in order, keeping a window of upcoming blocks prefetched
+ *
+ * The window is sized from what the scan is observed doing: it is about the number of blocks the
+ * caller gets through in the time one block takes to arrive from the file, so a quick scan over a
+ * slow file looks further ahead than a slow scan over a quick one. Block arrival time is measured
+ * from the gets that had to wait; the caller's time per block from the gaps between gets.
+ */
+class ReadAhead {
+public:
+    static const uint MIN_WINDOW = 4;
+    static const uint MAX_WINDOW = 64;
+
+    ReadAhead(DbFile &file, BlockCursor cursor);
+
+    virtual ~ReadAhead();
+
+    ReadAhead(const ReadAhead &other) = delete;
+
+    ReadAhead(ReadAhead &&temp) = delete;
+
+    ReadAhead &operator=(const ReadAhead &other) = delete;
+
+    ReadAhead &operator=(ReadAhead &&temp) = delete;
+
+    DbBlock *next();
+
+    uint get_window() const { return window; }
+
+    /**
+     * @returns  where the scan is up to (for resuming it later)
+     */
+    const BlockCursor &get_cursor() const { return cursor; }
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    DbFile &file;
+    BlockCursor range;   // all of the scan (for the file's begin_scan and end_scan)
+    BlockCursor cursor;  // next block to get
+    BlockCursor ahead;   // next block to hand to prefetch
+    BlockIDs upcoming;   // scratch for prefetch requests
+    uint window;
+    double fetch_us;     // running average time for a block that was not ready yet
+    double work_us;      // running average time the caller spends on a block
+    Clock::time_point last_get;
+
+    void adapt(double get_us, double gap_us);
+};
@@ -0,0 +1,70 @@
+/**
+ * @file row_codec.h - Compiled on-disk layout of a table's rows.
+ * RowCodec
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#pragma once
+
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class RowCodec - marshals rows of one table to and from the bytes of a record
+ *
+ * Worked out once from the table's columns. A record is laid out as:
+ *      the INT columns, 4 bytes each, then the BOOLEAN columns, 1 byte each (all at constant offsets)
+ *      for each TEXT column, the offset of the end of its bytes (2 bytes, or 4 for blocks bigger than 64 KB)
+ *      the bytes of the TEXT columns, one after another
+ * so any column is found without looking at the columns ahead of it. Within each group the columns
+ * are in order of name, the order a ValueDict holds them in, so a row is marshaled in one pass over
+ * its map, straight into the record's place in the page.
+ * The layout is stamped into the first block of the table's file (see SlottedPage::put_record_format),
+ * so that a file written in an older layout is refused when it is opened instead of being misread.
+ */
+class RowCodec {
+public:
+    /**
+     * Stamp for files of records laid out this way; change it whenever the layout changes.
+     */
+    static const uint32_t FORMAT = 1;
+
+    RowCodec(const ColumnNames &column_names, const ColumnAttributes &column_attributes, uint block_size);
+
+    virtual ~RowCodec() {}
+
+    RowCodec(const RowCodec &other) = delete;
+
+    RowCodec(RowCodec &&temp) = delete;
+
+    RowCodec &operator=(const RowCodec &other) = delete;
+
+    RowCodec &operator=(RowCodec &&temp) = delete;
+
+    uint32_t size(const ValueDict *row) const;
+
+    void marshal(const ValueDict *row, char *bytes) const;
+
+    void get(const char *bytes, uint col_num, Value &value, Arena *arena = nullptr) const;
+
+    bool equals(const char *bytes, uint col_num, const Value &value) const;
+
+protected:
+    struct Field {
+        ColumnAttribute::DataType data_type;
+        uint32_t offset;  // of the value for INT and BOOLEAN, of the end offset for TEXT
+    };
+
+    ColumnNames column_names;
+    std::vector<Field> fields;       // in column order
+    std::vector<uint> by_name;       // column numbers in name order, to walk a ValueDict alongside
+    uint32_t offset_size;            // bytes per TEXT end offset
+    uint32_t fixed_size;             // bytes of INT and BOOLEAN columns (where the TEXT end offsets begin)
+    uint32_t text_start;             // where the TEXT bytes begin
+    uint32_t max_size;               // biggest record we will make
+
+    void text(const char *bytes, uint col_num, const char *&data, uint32_t &size) const;
+
+    template<typename F>
+    void each(const ValueDict *row, F f) const;
+};
@@ -11,23 +11,103 @@
 
 #include "storage_engine.h"
 
+/**
+ * @class RecordView - non-owning view (pointer + length) of a record's bytes inside a SlottedPage.
+ * Only valid while the page it came from is alive and has not been changed.
+ */
+struct RecordView {
+    const char *data;
+    uint32_t size;
+
+    RecordView() : data(nullptr), size(0) {}
+
+    RecordView(const char *data, uint32_t size) : data(data), size(size) {}
+
+    /**
+     * @returns  true if the record was deleted (there are no bytes to view)
+     */
+    bool is_deleted() const { return data == nullptr; }
+};
+
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
  *
  *      Manage a database block that contains several records.
         Modeled after slotted-page from Database Systems Concepts, 6ed, Figure 10-9.
 
-        Record id are handed out sequentially starting with 1 as records are added with add().
+        Record id are handed out sequentially starting with 1 as records are added with add(), except that
+        the ids of deleted records are reused first.
         Each record has a header which is a fixed offset from the beginning of the block:
-            Bytes 0x00 - Ox01: number of records
-            Bytes 0x02 - 0x03: offset to end of free space
-            Bytes 0x04 - 0x05: size of record 1
-            Bytes 0x06 - 0x07: offset to record 1
+            Bytes 0x00 - 0x01: page format marker (FORMAT)
+            Bytes 0x02 - Ox03: number of records
+            Bytes 0x04 - 0x05: offset to end of free space
+            Bytes 0x06 - 0x07: number of fragmented (reclaimable) bytes in the record area
+            Bytes 0x08 - 0x09: id of the first deleted record available for reuse (0 if none)
+            Bytes 0x0A - 0x0B: format of the records, stamped by whoever owns the file (0 if not stamped)
+            Bytes 0x0C - 0x0D: size of record 1
+            Bytes 0x0E - 0x0F: offset to record 1
             etc.
+
+        The size of the page is the size of the block it is given. Pages bigger than 64 KB use the wide
+        variant of this layout, where every header field is 4 bytes instead of 2 (so the block header is
+        bytes 0x00 - 0x17 and the header of record 1 is bytes 0x18 - 0x1F).
+
+        A block whose first field is not FORMAT was written in an older layout (where the first field was
+        the number of records) and is refused rather than misread.
+
+        Nothing about the block is cached in the page object; every header field is read from the block
+        when it is needed. So any number of SlottedPages can be open on the same block (the same buffer
+        pool frame, say) and each sees the others' changes.
+
+        A deleted record's header has an offset of 0 (the tombstone) and, in place of the size, the id of the
+        next deleted record available for reuse, so the free slots form a chain starting in the block header.
+
+        Deleting or shrinking a record only marks its bytes as fragmented; nothing moves until compact()
+        is run, either because add() or put() actually needs the space or when the page is written out.
  *
  */
 class SlottedPage : public DbBlock {
 public:
+    /**
+     * @class SlottedPage::IDIterator - forward iterator over the live (undeleted) record ids.
+     * Walks the slot directory in place, so it allocates nothing. Invalidated by add().
+     */
+    class IDIterator {
+    public:
+        IDIterator(const SlottedPage *page, RecordID record_id) : page(page), record_id(record_id) { skip_deleted(); }
+
+        RecordID operator*() const { return record_id; }
+
+        IDIterator &operator++() {
+            record_id++;
+            skip_deleted();
+            return *this;
+        }
+
+        bool operator!=(const IDIterator &other) const { return record_id != other.record_id; }
+
+    protected:
+        const SlottedPage *page;
+        RecordID record_id;
+
+        void skip_deleted();
+    };
+
+    /**
+     * @class SlottedPage::IDRange - the live record ids of a page, for use in range-based for loops.
+     */
+    class IDRange {
+    public:
+        IDRange(const SlottedPage *page) : page(page) {}
+
+        IDIterator begin() const { return IDIterator(page, 1); }
+
+        IDIterator end() const { return IDIterator(page, (RecordID) (page->num_records() + 1)); }
+
+    protected:
+        const SlottedPage *page;
+    };
+
     SlottedPage(Dbt &block, BlockID block_id, bool is_new = false);
 
     // Big 5 - use the defaults
@@ -35,39 +115,97 @@ public:
 
     virtual RecordID add(const Dbt *data);
 
+    virtual char *reserve(uint32_t size, RecordID &record_id);
+
     virtual Dbt *get(RecordID record_id) const;
 
+    RecordView view(RecordID record_id) const;
+
     virtual void put(RecordID record_id, const Dbt &data);
 
     virtual void del(RecordID record_id);
 
     virtual RecordIDs *ids(void) const;
 
+    IDRange live_ids() const { return IDRange(this); }
+
     bool test_slotted_page();
     
     virtual void clear();
 
     virtual u_int16_t size() const;
 
-    virtual u_int16_t unused_bytes() const;
+    virtual u_int32_t unused_bytes() const;
+
+    uint32_t largest_addable() const;
+
+    virtual void compact();
+
+    /**
+     * Get the number of bytes left behind by deleted or shrunken records (reclaimed by compact()).
+     * @returns  number of fragmented bytes
+     */
+    uint32_t fragmented_bytes() const { return get_field(FRAG_BYTES); }
+
+    /**
+     * Get the format of the records, as stamped with put_record_format().
+     * @returns  the stamp, 0 if there is none
+     */
+    uint32_t get_record_format() const { return get_field(RECORD_FORMAT); }
+
+    /**
+     * Stamp the format of the records, so that the owner can tell an older file when it is opened.
+     * @param format  the owner's own format number
+     */
+    void put_record_format(uint32_t format) { put_field(RECORD_FORMAT, format); }
+
+    static uint32_t max_record_size(uint block_size);
+
+    static uint32_t record_header_size(uint block_size);
+
+    /**
+     * Largest page that fits the narrow (2-byte header field) layout.
+     */
+    static const uint32_t MAX_NARROW_SZ = 65536;
+
+    /**
+     * Marker in the first header field of every page. Larger than any record count an older page could
+     * have there; change it whenever the layout changes.
+     */
+    static const uint16_t FORMAT = 0xB106;
 
 protected:
-    uint16_t num_records;
-    uint16_t end_free;
+    // the fields of the block header, in order
+    enum HeaderField {
+        FORMAT_FIELD, NUM_RECORDS, END_FREE, FRAG_BYTES, FREE_SLOT, RECORD_FORMAT,
+        HEADER_FIELDS  // number of fields
+    };
+
+    uint32_t field_size;  // bytes per header field: 2, or 4 for the wide layout
+
+    uint32_t get_field(HeaderField field) const { return get_n(field * this->field_size); }
+
+    void put_field(HeaderField field, uint32_t n) { put_n(field * this->field_size, n); }
+
+    RecordID num_records() const { return (RecordID) get_field(NUM_RECORDS); }
+
+    uint32_t end_free() const { return get_field(END_FREE); }
+
+    RecordID free_slot() const { return (RecordID) get_field(FREE_SLOT); }
 
-    void get_header(uint16_t &size, uint16_t &loc, RecordID id = 0) const;
+    void get_header(uint32_t &size, uint32_t &loc, RecordID id) const;
 
-    void put_header(RecordID id = 0, uint16_t size = 0, uint16_t loc = 0);
+    void put_header(RecordID id, uint32_t size, uint32_t loc);
 
-    bool has_room(uint16_t size) const;
+    uint32_t header_offset(RecordID id) const;
 
-    virtual void slide(uint16_t start, uint16_t end);
+    uint32_t contiguous_bytes() const;
 
-    uint16_t get_n(uint16_t offset) const;
+    uint32_t get_n(uint32_t offset) const;
 
-    void put_n(uint16_t offset, uint16_t n);
+    void put_n(uint32_t offset, uint32_t n);
 
-    void *address(uint16_t offset) const;
+    void *address(uint32_t offset) const;
 };
 
 bool assertion_failure(std::string message, double x = -1, double y = -1);
\ No newline at end of file
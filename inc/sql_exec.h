@@ -28,13 +28,14 @@ public:
  */
 class QueryResult {
 public:
-    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), arena(nullptr), message("") {}
 
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
-                                       message(message) {}
+                                       arena(nullptr), message(message) {}
 
-    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
-            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, RowSet *rows, std::string message)
+            : column_names(column_names), column_attributes(column_attributes), rows(rows), arena(nullptr),
+              message(message) {}
 
     virtual ~QueryResult();
 
@@ -42,16 +43,23 @@ public:
 
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
 
-    ValueDicts *get_rows() const { return rows; }
+    RowSet *get_rows() const { return rows; }
 
     const std::string &get_message() const { return message; }
 
+    /**
+     * Hand over the statement's arena, which the rows may be using, to be freed along with them.
+     * @param arena  the statement's arena
+     */
+    void set_arena(Arena *arena) { this->arena = arena; }
+
     friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
 
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
-    ValueDicts *rows;
+    RowSet *rows;
+    Arena *arena;
     std::string message;
 };
 
@@ -68,6 +76,14 @@ public:
      */
     static QueryResult *execute(const hsql::SQLStatement *statement);
 
+    /**
+     * Execute a run of INSERT statements into one table as a single batch: the rows go in together
+     * and each index is updated in one pass. If any of it fails, none of the rows are left behind.
+     * @param statements  the Hyrise ASTs of the INSERT statements (all for the same table)
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult *execute(const std::vector<const hsql::InsertStatement *> &statements);
+
 protected:
     // the one place in the system that holds the _tables and _indices tables
     static Tables *tables;
@@ -90,9 +106,11 @@ protected:
 
     static QueryResult *insert(const hsql::InsertStatement *statement);
 
+    static QueryResult *insert(const std::vector<const hsql::InsertStatement *> &statements);
+
     static QueryResult *del(const hsql::DeleteStatement *statement);
 
-    static QueryResult *select(const hsql::SelectStatement *statement);
+    static QueryResult *select(const hsql::SelectStatement *statement, Arena *arena);
 
     static QueryResult *create_table(const hsql::CreateStatement *statement);
 
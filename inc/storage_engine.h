@@ -9,11 +9,14 @@
  */
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <map>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
+#include "arena.h"
 
 /**
  * Global variable to hold dbenv.
@@ -46,7 +49,7 @@ typedef std::length_error DbBlockNoRoomError;
 class DbBlock {
 public:
     /**
-     * our blocks are 4kB
+     * our blocks are 4kB unless the file asks for another size
      */
     static const uint BLOCK_SZ = 4096;
 
@@ -108,7 +111,7 @@ public:
      * Get the number of bytes not currently used to store data or for overhead.
      * @returns  number of unused bytes
      */
-    virtual u_int16_t unused_bytes() const = 0;
+    virtual u_int32_t unused_bytes() const = 0;
 
     /**
      * Access the whole block's memory as a BerkeleyDB Dbt pointer.
@@ -128,13 +131,54 @@ public:
      */
     virtual BlockID get_block_id() { return block_id; }
 
+    /**
+     * Get the size of this block (set by the DbFile it belongs to).
+     * @returns  number of bytes in the block
+     */
+    virtual uint get_block_size() const { return block.get_size(); }
+
 protected:
     Dbt block;
     BlockID block_id;
 };
 
 // convenience type alias
-typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<BlockID> BlockIDs;
+
+/**
+ * @class BlockCursor - walks the block ids of a DbFile from a start block to an end block, in order.
+ * A cursor is nothing but its position and end, so it is free to make, copy and keep; to resume a
+ * scan later, remember get_position() and ask the file for a new cursor starting there.
+ */
+class BlockCursor {
+public:
+    BlockCursor(BlockID start, BlockID end) : position(start), end(end) {}
+
+    /**
+     * @returns  true if there are no more blocks
+     */
+    bool at_end() const { return position == 0 || position > end; }
+
+    /**
+     * Take the next block id (only if not at_end()).
+     * @returns  the block id
+     */
+    BlockID next() { return position++; }
+
+    /**
+     * @returns  the block id next() would return
+     */
+    BlockID get_position() const { return position; }
+
+    /**
+     * @returns  the last block id of the cursor's range
+     */
+    BlockID get_end() const { return end; }
+
+protected:
+    BlockID position;
+    BlockID end;
+};
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -145,7 +189,9 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  * 	get_new()
  *	get(block_id)
  *	put(block)
- *	block_ids()
+ *	block_cursor(start, end)
+ *	prefetch(block_ids, count)
+ *	begin_scan(cursor), end_scan(cursor)
  */
 class DbFile {
 public:
@@ -194,11 +240,34 @@ public:
     virtual void put(DbBlock *block) = 0;
 
     /**
-     * Get a list of all the valid BlockID's in the file
-     * FIXME - not a good long-term approach, but we'll do this until we put in iterators
-     * @returns  a pointer to vector of BlockIDs (freed by caller)
+     * Get a cursor over the file's blocks, from start up to end or the file's current last block,
+     * whichever comes first.
+     * @param start  first block id of the range
+     * @param end    last block id of the range
+     * @returns      the cursor
      */
-    virtual BlockIDs *block_ids() const = 0;
+    virtual BlockCursor block_cursor(BlockID start = 1, BlockID end = UINT32_MAX) const = 0;
+
+    /**
+     * Hint that some blocks are about to be gotten, so the file can start reading them in the
+     * background. Just a hint: by default nothing happens.
+     * @param block_ids  the blocks, in the order they will be gotten
+     * @param count      how many
+     */
+    virtual void prefetch(const BlockID *block_ids, uint count) {}
+
+    /**
+     * Hint that the blocks of a cursor are about to be gotten one after another. Just a hint: by
+     * default nothing happens.
+     * @param cursor  the blocks of the scan
+     */
+    virtual void begin_scan(const BlockCursor &cursor) {}
+
+    /**
+     * Hint that a scan begun with begin_scan() is over (finished or given up on).
+     * @param cursor  the same blocks as were given to begin_scan()
+     */
+    virtual void end_scan(const BlockCursor &cursor) {}
 
 protected:
     std::string name;  // filename (or part of it)
@@ -231,18 +300,63 @@ protected:
 
 /**
  * @class Value - holds value for a field
+ *
+ * A tagged union in 16 bytes. INT and BOOLEAN values are held directly, as is TEXT of up to
+ * SMALL_TEXT characters; longer TEXT is held in a separate allocation that the Value owns, or, with
+ * set_text_ref(), is just pointed at where it already is (in an Arena, say), which must then outlast
+ * the Value. Copying a Value always gives it its own characters.
+ *      Bytes 0x00 - 0x0D: the INT or BOOLEAN value, the short TEXT's characters, or, for long TEXT,
+ *                         a pointer to the characters (0x00 - 0x07) and their number (0x08 - 0x0B)
+ *      Byte  0x0E:        number of characters in a short TEXT, or LONG_TEXT or TEXT_REF
+ *      Byte  0x0F:        data type
  */
 class Value {
 public:
-    ColumnAttribute::DataType data_type;
-    int32_t n;
-    std::string s;
+    static const uint32_t SMALL_TEXT = 14;
+
+    Value() : number(0) { set_tag(ColumnAttribute::INT); }
+
+    Value(int32_t n) : number(n) { set_tag(ColumnAttribute::INT); }
+
+    Value(const char *s) { set_tag(ColumnAttribute::TEXT); init_text(s, strlen(s)); }
 
-    Value() : n(0) { data_type = ColumnAttribute::INT; }
+    Value(const std::string &s) { set_tag(ColumnAttribute::TEXT); init_text(s.data(), s.length()); }
 
-    Value(int32_t n) : n(n) { data_type = ColumnAttribute::INT; }
+    Value(const Value &other);
 
-    Value(std::string s) : s(s) { data_type = ColumnAttribute::TEXT; }
+    Value(Value &&temp);
+
+    Value &operator=(const Value &other);
+
+    Value &operator=(Value &&temp);
+
+    ~Value() { release(); }
+
+    ColumnAttribute::DataType get_data_type() const { return (ColumnAttribute::DataType) bytes[15]; }
+
+    /**
+     * @returns  the INT value (or 0/1 for a BOOLEAN)
+     */
+    int32_t get_int() const { return number; }
+
+    bool get_boolean() const { return number != 0; }
+
+    /**
+     * @returns  a copy of the TEXT value
+     */
+    std::string get_text() const { return std::string(text_data(), text_size()); }
+
+    const char *text_data() const { return is_long_text() ? heap.chars : bytes; }
+
+    uint32_t text_size() const { return is_long_text() ? heap.size : (uint8_t) bytes[14]; }
+
+    void set_int(int32_t n);
+
+    void set_boolean(bool b);
+
+    void set_text(const char *data, size_t size);
+
+    void set_text_ref(const char *data, size_t size);
 
     bool operator==(const Value &other) const;
 
@@ -251,6 +365,33 @@ public:
     bool operator<(const Value &other) const;
 
     friend std::ostream &operator<<(std::ostream &out, const Value &value);
+
+protected:
+    static const uint8_t LONG_TEXT = 0xFF;  // characters are ours
+    static const uint8_t TEXT_REF = 0xFE;   // characters belong to someone else
+
+    union {
+        int32_t number;
+        struct {
+            char *chars;
+            uint32_t size;
+        } heap;
+        char bytes[16];
+    };
+
+    void set_tag(ColumnAttribute::DataType data_type) { bytes[15] = (char) data_type; }
+
+    bool is_long_text() const {
+        return get_data_type() == ColumnAttribute::TEXT && (uint8_t) bytes[14] >= TEXT_REF;
+    }
+
+    bool is_owned_text() const {
+        return get_data_type() == ColumnAttribute::TEXT && (uint8_t) bytes[14] == LONG_TEXT;
+    }
+
+    void init_text(const char *data, size_t size);
+
+    void release();
 };
 
 // More type aliases
@@ -272,6 +413,120 @@ public:
 };
 
 
+/**
+ * @class Schema - names and types of the columns of a Row, in order. Shared by all the rows of a RowSet.
+ */
+class Schema {
+public:
+    Schema(const ColumnNames &column_names, const ColumnAttributes &column_attributes)
+            : column_names(column_names), column_attributes(column_attributes) {}
+
+    const ColumnNames &get_column_names() const { return column_names; }
+
+    const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    uint size() const { return (uint) column_names.size(); }
+
+    uint ordinal(const Identifier &column_name) const;
+
+protected:
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+};
+
+
+/**
+ * @class Row - values for the columns of a Schema, by position
+ *
+ * The values sit in an array (in their RowSet's arena) instead of a tree node and a copy of the column
+ * name per value as in a ValueDict. Columns are got at by ordinal, worked out once from the schema.
+ * at() and to_dict() are there for code that still works by column name.
+ */
+class Row {
+public:
+    Row(const Schema *schema, Value *values) : schema(schema), values(values) {}
+
+    const Schema &get_schema() const { return *schema; }
+
+    uint size() const { return schema->size(); }
+
+    Value &operator[](uint ordinal) { return values[ordinal]; }
+
+    const Value &operator[](uint ordinal) const { return values[ordinal]; }
+
+    const Value &at(const Identifier &column_name) const { return values[schema->ordinal(column_name)]; }
+
+    ValueDict *to_dict() const;
+
+protected:
+    const Schema *schema;
+    Value *values;
+};
+
+
+/**
+ * @class RowSet - rows sharing one schema, which the set owns
+ *
+ * The rows' values are allocated from an arena: the one given (typically the statement's), or else
+ * one of the set's own. Long TEXT values decoded into the set can point into the same arena.
+ */
+class RowSet {
+public:
+    RowSet(const ColumnNames &column_names, const ColumnAttributes &column_attributes, Arena *arena = nullptr)
+            : schema(column_names, column_attributes), arena(arena), own_arena(nullptr) {
+        if (arena == nullptr)
+            this->arena = this->own_arena = new Arena();
+    }
+
+    virtual ~RowSet();
+
+    // the rows point at our schema, so we stay put
+    RowSet(const RowSet &other) = delete;
+
+    RowSet(RowSet &&temp) = delete;
+
+    RowSet &operator=(const RowSet &other) = delete;
+
+    RowSet &operator=(RowSet &&temp) = delete;
+
+    const Schema &get_schema() const { return schema; }
+
+    /**
+     * @returns  where the rows' values (and anything else that should last as long) are allocated
+     */
+    Arena *get_arena() const { return arena; }
+
+    /**
+     * Append a row of default values, for the caller to fill in.
+     * @returns  the new row (good until the next add)
+     */
+    Row &add() {
+        rows.emplace_back(&schema, arena->make_array<Value>(schema.size()));
+        return rows.back();
+    }
+
+    void add(size_t n);
+
+    void add(const ValueDict &row);
+
+    size_t size() const { return rows.size(); }
+
+    Row &operator[](size_t i) { return rows[i]; }
+
+    const Row &operator[](size_t i) const { return rows[i]; }
+
+    std::vector<Row>::const_iterator begin() const { return rows.begin(); }
+
+    std::vector<Row>::const_iterator end() const { return rows.end(); }
+
+protected:
+    Schema schema;
+    std::vector<Row> rows;
+    Arena *arena;
+    Arena *own_arena;
+};
+
+
 /**
  * @class DbRelation - top-level object handling a physical database relation
  * 
@@ -335,6 +590,15 @@ public:
      */
     virtual Handle insert(const ValueDict *row) = 0;
 
+    /**
+     * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> ), ( <row_values> ), ...
+     * All the rows go in or none do. By default just inserts them one at a time, deleting the ones
+     * already in if one fails.
+     * @param rows  dictionaries keyed by column names
+     * @returns     handles to the new rows, in the same order (freed by caller)
+     */
+    virtual Handles *insert_batch(const ValueDicts *rows);
+
     /**
      * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g., returned
@@ -348,6 +612,8 @@ public:
      * Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g, returned
      * from an insert or select).
+     * The handle is dead afterwards: the storage engine may give the same handle to a row inserted
+     * later, so a copy kept past the delete (in an index, say) can name a different row.
      * @param handle   the row to delete
      */
     virtual void del(const Handle handle) = 0;
@@ -406,6 +672,16 @@ public:
 
     virtual ValueDicts *project(Handles *handles, const ValueDict *column_names);
 
+    /**
+     * Return the values for each of the given handles in a positional RowSet (SELECT <column_names>).
+     * @param handles       rows to get values from
+     * @param column_names  list of column names to project (nullptr or empty for all of them)
+     * @param arena         where to allocate the rows (nullptr for the row set to have its own)
+     * @returns             rows of values, in the order of handles and column_names (freed by caller)
+     */
+    virtual RowSet *project_rows(Handles *handles, const ColumnNames *column_names = nullptr,
+                                 Arena *arena = nullptr);
+
     /**
      * Accessor for column_names.
      * @returns column_names   list of column names for this relation, in order
@@ -443,6 +719,10 @@ protected:
     Identifier table_name;
     ColumnNames column_names;
     ColumnAttributes column_attributes;
+
+    virtual RowSet *new_row_set(const ColumnNames *column_names, Arena *arena) const;
+
+    virtual std::vector<uint> ordinals(const ColumnNames &select_column_names) const;
 };
 
 
@@ -505,6 +785,13 @@ public:
      */
     virtual void insert(Handle record) = 0;
 
+    /**
+     * Insert the index entries for a batch of records, all or none of them. By default just inserts
+     * them one at a time, deleting the ones already in if one fails.
+     * @param records  handles (into relation) to the records to insert
+     */
+    virtual void insert_batch(const Handles *records);
+
     /**
      * Delete the index entry for the given record.
      * @param record  handle (into relation) to the record to remove
@@ -512,6 +799,16 @@ public:
      */
     virtual void del(Handle record) = 0;
 
+    /**
+     * @returns  the relation this index is on
+     */
+    DbRelation &get_relation() const { return relation; }
+
+    /**
+     * @returns  the columns of the search key
+     */
+    const ColumnNames &get_key_columns() const { return key_columns; }
+
 protected:
     DbRelation &relation;
     Identifier name;
@@ -4,7 +4,9 @@
  * @see "Seattle University, CPSC5300, Winter Quarter 2024"
  */
 
+#include <algorithm>
 #include <cstring>
+#include <memory>
 #include "BTreeNode.h"
 
 using namespace std;
@@ -20,7 +22,7 @@ BTreeNode::BTreeNode(HeapFile &file, BlockID block_id, const KeyProfile &key_pro
                                                                                                              key_profile) {
     if (create) {
         this->block = file.get_new();
-        this->id = this->block->get_block_id();
+        this->id = page()->get_block_id();
     } else {
         this->block = file.get(block_id);
     }
@@ -31,57 +33,73 @@ BTreeNode::~BTreeNode() {
     this->block = nullptr;
 }
 
+// Write the block and let go of it (see unpin).
 void BTreeNode::save() {
-    this->file.put(this->block);
+    this->file.put(page());
+    unpin();
+}
+
+// Let go of the block. Whatever was decoded from it stays usable; the block is pinned again when it is
+// looked at or changed. A node kept around decoded doesn't tie up a buffer pool frame this way.
+void BTreeNode::unpin() {
+    delete this->block;
+    this->block = nullptr;
+}
+
+// The node's block, pinning it again if it was let go of.
+SlottedPage *BTreeNode::page() const {
+    if (this->block == nullptr)
+        this->block = this->file.get(this->id);
+    return this->block;
 }
 
 // Get the record and turn it into a block ID.
 BlockID BTreeNode::get_block_id(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    BlockID block_id = *(BlockID *) dbt->get_data();
-    delete dbt;
-    return block_id;
+    RecordView record = page()->view(record_id);
+    return *(BlockID *) record.data;
 }
 
 // Get the record and turn it into a Handle.
 Handle BTreeNode::get_handle(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    BlockID handle_block_id = *(BlockID *) dbt->get_data();
-    RecordID handle_record_id = *(RecordID *) ((char *) dbt->get_data() + sizeof(BlockID));
-    delete dbt;
+    RecordView record = page()->view(record_id);
+    BlockID handle_block_id = *(BlockID *) record.data;
+    RecordID handle_record_id = *(RecordID *) (record.data + sizeof(BlockID));
     return Handle(handle_block_id, handle_record_id);
 }
 
 // Get the record and turn it into a KeyValue.
 KeyValue *BTreeNode::get_key(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    char *bytes = (char *) dbt->get_data();
-    KeyValue *key_value = new KeyValue();
-    Value value;
+    KeyValue *key_value = new KeyValue(this->key_profile.size());
+    get_key(record_id, key_value->data());
+    return key_value;
+}
+
+// Get the record and decode it into the key's values, one for each column of the key.
+void BTreeNode::get_key(RecordID record_id, Value *key) const {
+    unmarshal_key(page()->view(record_id).data, key);
+}
+
+// Decode a marshaled key into the key's values, one for each column of the key.
+void BTreeNode::unmarshal_key(const char *bytes, Value *key) const {
     uint offset = 0;
+    uint col_num = 0;
     for (auto const &data_type: this->key_profile) {
-        value.data_type = data_type;
+        Value &value = key[col_num++];
         if (data_type == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t *) (bytes + offset);
+            value.set_int(*(int32_t *) (bytes + offset));
             offset += sizeof(int32_t);
         } else if (data_type == ColumnAttribute::DataType::TEXT) {
             uint16_t size = *(uint16_t *) (bytes + offset);
             offset += sizeof(uint16_t);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = std::string(buffer);  // assume ascii for now
+            value.set_text(bytes + offset, size);  // assume ascii for now
             offset += size;
         } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t *) (bytes + offset);
+            value.set_boolean(*(uint8_t *) (bytes + offset) != 0);
             offset += sizeof(uint8_t);
         } else {
             throw DbRelationError("Only know how to unmarshal INT, TEXT, or BOOLEAN");
         }
-        key_value->push_back(value);
     }
-    delete dbt;
-    return key_value;
 }
 
 // Convert block_id into bytes.
@@ -103,36 +121,42 @@ Dbt *BTreeNode::marshal_handle(Handle handle) {
 
 // Convert KeyValue into bytes.
 Dbt *BTreeNode::marshal_key(const KeyValue *key) {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need
+    return marshal_key(key->data());
+}
+
+// Convert the key's values, one for each column of the key, into bytes.
+Dbt *BTreeNode::marshal_key(const Value *key) {
+    uint block_size = this->file.get_block_size();
+    char *bytes = new char[block_size]; // more than we need
     uint offset = 0;
     uint col_num = 0;
     for (auto const &data_type: this->key_profile) {
-        Value value = (*key)[col_num];
+        const Value &value = key[col_num++];
 
         if (data_type == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
+            if (offset + 4 > block_size - 4)
                 throw DbRelationError("index key too big to marshal");
 
-            *(int32_t *) (bytes + offset) = value.n;
+            *(int32_t *) (bytes + offset) = value.get_int();
             offset += sizeof(int32_t);
 
         } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            u_long size = (uint16_t) value.s.length();
+            u_long size = value.text_size();
             if (size > UINT16_MAX)
                 throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
+            if (offset + 2 + size > block_size)
                 throw DbRelationError("index key too big to marshal");
 
             *(uint16_t *) (bytes + offset) = (uint16_t) size;
             offset += sizeof(uint16_t);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
+            memcpy(bytes + offset, value.text_data(), size); // assume ascii for now
             offset += size;
 
         } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
+            if (offset + 1 > block_size - 1)
                 throw DbRelationError("index key too big to marshal");
 
-            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
+            *(uint8_t *) (bytes + offset) = (uint8_t) value.get_int();
             offset += sizeof(uint8_t);
 
         } else {
@@ -146,6 +170,26 @@ Dbt *BTreeNode::marshal_key(const KeyValue *key) {
     return data;
 }
 
+// For a bulk load: add two records to the block, just to see how full that leaves it (an interior node's save()
+// rewrites the block anyway). True if the block is still no more than limit bytes full and has room left for a
+// block id (the node's first pointer). Frees both Dbts.
+bool BTreeNode::fill(Dbt *first, Dbt *second, uint32_t limit) {
+    bool fits;
+    try {
+        page()->add(first);
+        page()->add(second);
+        fits = this->file.get_block_size() - page()->unused_bytes() <= limit &&
+               page()->largest_addable() >= sizeof(BlockID);
+    } catch (DbBlockNoRoomError &e) {
+        fits = false;
+    }
+    for (Dbt *dbt: {first, second}) {
+        delete[] (char *) dbt->get_data();
+        delete dbt;
+    }
+    return fits;
+}
+
 
 /******************************
  * BTreeStat statistics block *
@@ -164,23 +208,24 @@ BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id, const KeyProfile &key_prof
                                                                                                  key_profile, false),
                                                                                        root_id(get_block_id(ROOT)),
                                                                                        height(get_block_id(HEIGHT)) {
+    unpin();
 }
 
 void BTreeStat::save() {
     Dbt *dbt = marshal_block_id(this->root_id);
-    bool is_new = (this->block->size() == 0);
+    bool is_new = (page()->size() == 0);
     if (is_new)
-        this->block->add(dbt);
+        page()->add(dbt);
     else
-        this->block->put(ROOT, *dbt);
+        page()->put(ROOT, *dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
 
     dbt = marshal_block_id(this->height);  // not really a block ID but it fits
     if (is_new)
-        this->block->add(dbt);
+        page()->add(dbt);
     else
-        this->block->put(HEIGHT, *dbt);
+        page()->put(HEIGHT, *dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
 
@@ -195,9 +240,7 @@ void BTreeStat::save() {
 BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create) : BTreeNode(
         file, block_id, key_profile, create), first(0), pointers(), boundaries() {
     if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
+        for (RecordID i: page()->live_ids()) {
             if (i == 1) {
                 // first pointer
                 this->first = get_block_id(i);
@@ -206,58 +249,74 @@ BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile
                 this->pointers.push_back(get_block_id(i));
             } else {
                 // key
-                KeyValue *key_value = get_key(i);
-                this->boundaries.push_back(key_value);
+                this->boundaries.resize(this->boundaries.size() + this->key_profile.size());
+                get_key(i, &this->boundaries[this->boundaries.size() - this->key_profile.size()]);
             }
-            i++;
         }
-        delete record_id_list;
+        unpin();
     }
 }
 
 BTreeInterior::~BTreeInterior() {
-    for (auto key_value: this->boundaries)
-        delete key_value;
-    this->boundaries.clear();
 }
 
 // Get next block down in tree where key must be.
-BTreeNode *BTreeInterior::find(const KeyValue *key, uint depth) const {
-    BlockID down = this->pointers.back();  // last pointer is correct if we don't find an earlier boundary
-    for (uint i = 0; i < this->boundaries.size(); i++) {
-        KeyValue *boundary = this->boundaries[i];
-        if (*boundary > *key) {
-            if (i > 0)
-                down = this->pointers[i - 1];
-            else
-                down = this->first;
-            break;
+BlockID BTreeInterior::find(const KeyValue *key) const {
+    size_t i = child_index(key);
+    return i == 0 ? this->first : this->pointers[i - 1];
+}
+
+// Which pointer key is under: the number of boundaries no greater than key (0 for first). A binary search
+// over the boundaries, which sit one after another in one array, that halves the range without branching
+// on the comparison.
+size_t BTreeInterior::child_index(const KeyValue *key) const {
+    size_t base = 0, len = this->pointers.size();
+    if (len == 0)
+        return 0;
+    while (len > 1) {
+        size_t half = len / 2;
+        base += not_above(base + half, key) ? half : 0;
+        len -= half;
+    }
+    return base + (not_above(base, key) ? 1 : 0);
+}
+
+// Is boundary i no greater than key?
+bool BTreeInterior::not_above(size_t i, const KeyValue *key) const {
+    const Value *boundary = this->boundary(i);
+    for (size_t col_num = 0; col_num < this->key_profile.size(); col_num++) {
+        const Value &b = boundary[col_num], &k = (*key)[col_num];
+        if (this->key_profile[col_num] == ColumnAttribute::INT) {
+            if (b.get_int() != k.get_int())
+                return b.get_int() < k.get_int();
+        } else {
+            if (b < k)
+                return true;
+            if (k < b)
+                return false;
         }
     }
-    if (depth == 2)
-        return new BTreeLeaf(this->file, down, this->key_profile, false);
-    else
-        return new BTreeInterior(this->file, down, this->key_profile, false);
+    return true;
 }
 
 // Save the pointers and boundaries in the correct order
 void BTreeInterior::save() {
     Dbt *dbt;
-    this->block->clear();
+    page()->clear();
     dbt = marshal_block_id(this->first);
-    this->block->add(dbt);
+    page()->add(dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
-    for (uint i = 0; i < this->boundaries.size(); i++) {
+    for (uint i = 0; i < this->pointers.size(); i++) {
         // key
-        dbt = marshal_key(this->boundaries[i]);
-        this->block->add(dbt);
+        dbt = marshal_key(boundary(i));
+        page()->add(dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
 
         // boundary
         dbt = marshal_block_id(this->pointers[i]);
-        this->block->add(dbt);
+        page()->add(dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
     }
@@ -267,33 +326,23 @@ void BTreeInterior::save() {
 // Insert boundary, block_id pair into block.
 Insertion BTreeInterior::insert(const KeyValue *boundary, BlockID block_id) {
     // cout << "inserting (" << block_id << ", " << (*boundary)[0] << ") into interior node " << id; // DEBUG
-    // cout << " (pointers:" << boundaries.size() << ", unused:" << block->unused_bytes() << ") " << endl; // DEBUG
+    // cout << " (pointers:" << pointers.size() << ", unused:" << block->unused_bytes() << ") " << endl; // DEBUG
 
     Dbt *dbt;
 
-    bool inserted = false;
-    for (uint i = 0; i < this->boundaries.size(); i++) {
-        KeyValue *check = this->boundaries[i];
-        if (*boundary == *check) {
-            this->boundaries.insert(this->boundaries.begin() + i, new KeyValue(*boundary));
-            this->pointers.insert(this->pointers.begin() + i, block_id);
-            inserted = true;
-            break;
-        }
-    }
-    if (!inserted) {
-        // must go at the end
-        this->boundaries.push_back(new KeyValue(*boundary));
-        this->pointers.push_back(block_id);
-    }
+    // goes just after the boundaries no greater than it
+    size_t at = child_index(boundary);
+    this->boundaries.insert(this->boundaries.begin() + at * this->key_profile.size(), boundary->begin(),
+                            boundary->end());
+    this->pointers.insert(this->pointers.begin() + at, block_id);
     dbt = marshal_block_id(block_id);
     try {
         // following is just a check for size (the save method will redo this in the right order)
-        this->block->add(dbt);
+        page()->add(dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
         dbt = marshal_key(boundary);
-        this->block->add(dbt);
+        page()->add(dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
 
@@ -313,18 +362,15 @@ Insertion BTreeInterior::insert(const KeyValue *boundary, BlockID block_id) {
 
         // only the pointer of the middle entry goes into the sister (as it's first pointer)
         // the corresponding boundary is moved up to be inserted into the parent node
-        u_long split = this->boundaries.size() / 2;
+        size_t width = this->key_profile.size();
+        u_long split = this->pointers.size() / 2;
         nnode->first = this->pointers[split];
-        KeyValue *nboundary = this->boundaries[split];
-        Insertion ret(nnode->id, *nboundary);
-        delete nboundary;
+        Insertion ret(nnode->id, KeyValue(this->boundary(split), this->boundary(split) + width));
 
         // move half of the entries to the sister
-        for (u_long i = split + 1; i < this->boundaries.size(); i++) {
-            nnode->boundaries.push_back(this->boundaries[i]);
-            nnode->pointers.push_back(this->pointers[i]);
-        }
-        this->boundaries.erase(this->boundaries.begin() + split, this->boundaries.end());
+        nnode->boundaries.assign(this->boundaries.begin() + (split + 1) * width, this->boundaries.end());
+        nnode->pointers.assign(this->pointers.begin() + split + 1, this->pointers.end());
+        this->boundaries.erase(this->boundaries.begin() + split * width, this->boundaries.end());
         this->pointers.erase(this->pointers.begin() + split, this->pointers.end());
         // cout << "after split " << *this << endl; // DEBUG
         // cout << "new sibling " << *nnode << endl; // DEBUG
@@ -332,18 +378,29 @@ Insertion BTreeInterior::insert(const KeyValue *boundary, BlockID block_id) {
         // save everything
         nnode->save();
         this->save();
+        delete nnode;
         return ret;
     }
 }
 
+// For a bulk load: put the next (boundary, block_id) pair, in key order, at the end, if the node stays within
+// limit bytes. A node with no boundaries yet takes one regardless. Not saved until save().
+bool BTreeInterior::append(const KeyValue *boundary, BlockID block_id, uint32_t limit) {
+    Dbt *dbt = marshal_key(boundary);
+    if (!fill(dbt, marshal_block_id(block_id), limit) && !this->pointers.empty())
+        return false;
+    this->boundaries.insert(this->boundaries.end(), boundary->begin(), boundary->end());
+    this->pointers.push_back(block_id);
+    return true;
+}
 
 ostream &operator<<(ostream &out, const BTreeInterior &node) {
     out << "(interior block " << node.id << "): " << node.first;
-    if (node.boundaries.size() != node.pointers.size()) {
+    if (node.boundaries.size() != node.pointers.size() * node.key_profile.size()) {
         out << " MISMATCH boundaries: " << node.boundaries.size() << ", pointers: " << node.pointers.size();
     } else {
-        for (unsigned int i = 0; i < node.boundaries.size(); i++)
-            out << '|' << (*node.boundaries[i])[0] << '|' << node.pointers[i];
+        for (unsigned int i = 0; i < node.pointers.size(); i++)
+            out << '|' << node.boundary(i)[0] << '|' << node.pointers[i];
     }
     return out;
 }
@@ -356,24 +413,11 @@ ostream &operator<<(ostream &out, const BTreeInterior &node) {
 BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create) : BTreeNode(file,
                                                                                                                block_id,
                                                                                                                key_profile,
-                                                                                                               create),
-                                                                                                     next_leaf(0),
-                                                                                                     key_map() {
-    if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
-            if (i == record_id_list->size()) {
-                // next leaf block
-                this->next_leaf = get_block_id(i);
-            } else if (i % 2 == 0) {
-                // record i-1: handle, record i: key
-                KeyValue *key_value = get_key(i);
-                this->key_map[*key_value] = get_handle(i - 1);
-            }
-            i++;
-        }
-        delete record_id_list;
+                                                                                                               create) {
+    if (create) {
+        put_directory(0, nullptr, 0);
+    } else {
+        unpin();  // nothing to decode; everything is looked at right in the block
     }
 }
 
@@ -382,95 +426,250 @@ BTreeLeaf::~BTreeLeaf() {
 
 // Find the handle for a given key
 Handle BTreeLeaf::find_eq(const KeyValue *key) const {
-    return this->key_map.at(*key);
+    uint at = lower_bound(key);
+    if (at == size() || compare(entry(at), key) != 0)
+        throw DbRelationError("key not found in leaf");
+    return get_handle(entry_id(at));
 }
 
-// Save the key_map and next_leaf data in the correct order
-void BTreeLeaf::save() {
-    Dbt *dbt;
-    this->block->clear();
-    for (auto const &item: this->key_map) {
-        // handle
-        dbt = marshal_handle(item.second);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
+// The next leaf to the right (0 for the last one).
+BlockID BTreeLeaf::get_next_leaf() const {
+    return *(BlockID *) page()->view(DIRECTORY).data;
+}
 
-        // key
-        dbt = marshal_key(&item.first);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-    }
-    // next leaf pointer is final record
-    dbt = marshal_block_id(this->next_leaf);
-    this->block->add(dbt);
-    delete[] (char *) dbt->get_data();
-    delete dbt;
+// Point this leaf at the next one to the right. Not saved until save().
+void BTreeLeaf::set_next_leaf(BlockID next_leaf) {
+    RecordView directory = page()->view(DIRECTORY);
+    put_directory(next_leaf, (const RecordID *) (directory.data + sizeof(BlockID)),
+                  (directory.size - sizeof(BlockID)) / sizeof(RecordID));
+}
 
-    BTreeNode::save();
+// Number of entries in the leaf.
+uint BTreeLeaf::size() const {
+    return (page()->view(DIRECTORY).size - sizeof(BlockID)) / sizeof(RecordID);
 }
 
-// Insert key, handle pair into block.
+// Record id of the entry that is at in key order.
+RecordID BTreeLeaf::entry_id(uint at) const {
+    return *(RecordID *) (page()->view(DIRECTORY).data + sizeof(BlockID) + at * sizeof(RecordID));
+}
+
+// The marshaled key of the entry that is at in key order.
+const char *BTreeLeaf::entry(uint at) const {
+    return page()->view(entry_id(at)).data + HANDLE_SZ;
+}
+
+// Decode the key of the entry that is at in key order (freed by caller).
+KeyValue *BTreeLeaf::get_key_at(uint at) const {
+    KeyValue *key = new KeyValue(this->key_profile.size());
+    unmarshal_key(entry(at), key->data());
+    return key;
+}
+
+// The handle of the entry that is at in key order.
+Handle BTreeLeaf::get_handle_at(uint at) const {
+    return get_handle(entry_id(at));
+}
+
+// Insert key, handle pair into block. The entry goes in as a record of its own and its id into the directory
+// at its place in key order; nothing else in the block moves. If it doesn't fit, the leaf is split at the byte
+// midpoint of its entries, the new one included: the upper ones go to a new leaf to the right and this one is
+// rebuilt with the rest. Both sides are checked to fit first, so a leaf that can't be split is left as it was.
 Insertion BTreeLeaf::insert(const KeyValue *key, Handle handle) {
     // cout << "inserting " << (*key)[0] << " into leaf " << id << endl; // DEBUG
     // check unique
-    if (this->key_map.find(*key) != this->key_map.end())
+    uint at = lower_bound(key);
+    if (at < size() && compare(entry(at), key) == 0)
         throw DbRelationError("Duplicate keys are not allowed in unique index");
 
-    Dbt *dbt;
-    dbt = marshal_handle(handle);
-    try {
-        // following is just a check for size (the save method will redo this in the right order)
-        this->block->add(dbt);
+    Dbt *dbt = marshal_entry(key, handle);
+    if (page()->largest_addable() >= dbt->get_size() + sizeof(RecordID)) {
+        add_entry(at, dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
-        dbt = marshal_key(key);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-
-        // that worked, so no need to split
-        this->key_map[*key] = handle;
         save();
         return BTreeNode::insertion_none();
+    }
 
-    } catch (DbBlockNoRoomError &e) {
-        delete[] (char *) dbt->get_data();
-        delete dbt;
+    // too big, so split
+
+    // all the entries in key order, the new one included, copied out since this block is about to be rebuilt
+    uint count = size() + 1;
+    std::vector<char> bytes;
+    std::vector<uint32_t> starts(count + 1);
+    for (uint i = 0, from = 0; i < count; i++) {
+        starts[i] = (uint32_t) bytes.size();
+        const char *data = (const char *) dbt->get_data();
+        uint32_t data_size = dbt->get_size();
+        if (i != at) {
+            RecordView record = page()->view(entry_id(from++));
+            data = record.data;
+            data_size = record.size;
+        }
+        bytes.insert(bytes.end(), data, data + data_size);
+    }
+    starts[count] = (uint32_t) bytes.size();
+    delete[] (char *) dbt->get_data();
+    delete dbt;
 
-        // too big, so split
+    // split at the byte midpoint; an entry takes its bytes, its record header and its place in the directory
+    uint32_t overhead = SlottedPage::record_header_size(this->file.get_block_size()) + sizeof(RecordID);
+    uint32_t room = SlottedPage::max_record_size(this->file.get_block_size()) - sizeof(BlockID);
+    auto footprint = [&starts, overhead](uint from, uint to) {
+        return starts[to] - starts[from] + (to - from) * overhead;
+    };
+    uint split = 1;
+    while (split < count - 1 && footprint(0, split + 1) <= footprint(0, count) / 2)
+        split++;
+    while (split < count - 1 && footprint(split, count) > room && footprint(0, split + 1) <= room)
+        split++;  // a big entry on the right: move the split over it
+    while (split > 1 && footprint(0, split) > room && footprint(split - 1, count) <= room)
+        split--;  // or on the left
+    if (footprint(0, split) > room || footprint(split, count) > room)
+        throw DbBlockNoRoomError("index entries too big to split the leaf");  // nothing has been changed yet
+
+    // create the sister and put her to the right, with the upper half of the entries
+    std::unique_ptr<BTreeLeaf> nleaf(new BTreeLeaf(this->file, 0, this->key_profile, true));
+    std::vector<RecordID> ids;
+    for (uint i = split; i < count; i++) {
+        Dbt entry(&bytes[starts[i]], starts[i + 1] - starts[i]);
+        ids.push_back(nleaf->page()->add(&entry));
+    }
+    nleaf->put_directory(get_next_leaf(), ids.data(), (uint) ids.size());
+
+    // and start this one over with the lower half
+    page()->clear();
+    put_directory(nleaf->id, nullptr, 0);
+    ids.clear();
+    for (uint i = 0; i < split; i++) {
+        Dbt entry(&bytes[starts[i]], starts[i + 1] - starts[i]);
+        ids.push_back(page()->add(&entry));
+    }
+    put_directory(nleaf->id, ids.data(), split);
 
-        // create the sister and put her to the right
-        BTreeLeaf *nleaf = new BTreeLeaf(this->file, 0, this->key_profile, true);
-        nleaf->next_leaf = this->next_leaf;
-        this->next_leaf = nleaf->id;
+    KeyValue *boundary = nleaf->get_key_at(0);
+    cout << "splitting leaf " << id << ", new sibling " << nleaf->id; // DEBUG
+    cout << " starting at value " << (*boundary)[0] << endl; // DEBUG
 
-        // move half of the entries to the sister
-        auto key_list = this->key_map;       // make a copy of my key_map
-        key_list[*key] = handle;             // add key/handle to it
-        u_long split = key_list.size() / 2;  // figure out how many to keep (the rest move to nleaf)
-        this->key_map.clear();               // empty my list
-        u_long i = 0;
-        KeyValue boundary;
-        for (auto const &item: key_list) {
-            if (i < split) {
-                this->key_map[item.first] = item.second;
-            } else if (i == split) {
-                boundary = item.first;
-                nleaf->key_map[boundary] = item.second;
-            } else {
-                nleaf->key_map[item.first] = item.second;
-            }
-            i++;
-        }
-        cout << "splitting leaf " << id << ", new sibling " << nleaf->id; // DEBUG
-        cout << " starting at value " << boundary[0] << endl; // DEBUG
+    nleaf->save();
+    this->save();
+    Insertion ret(nleaf->id, *boundary);
+    delete boundary;
+    return ret;
+}
 
-        nleaf->save();
-        this->save();
-        return Insertion(nleaf->id, boundary);
+// Remove the entry for key, if it is there: its record is deleted and its id taken out of the directory.
+// Returns false if there was no such entry.
+bool BTreeLeaf::del(const KeyValue *key) {
+    uint at = lower_bound(key);
+    if (at == size() || compare(entry(at), key) != 0)
+        return false;
+    RecordView directory = page()->view(DIRECTORY);
+    uint count = (directory.size - sizeof(BlockID)) / sizeof(RecordID);
+    std::vector<RecordID> ids((const RecordID *) (directory.data + sizeof(BlockID)),
+                              (const RecordID *) (directory.data + sizeof(BlockID)) + count);
+    page()->del(ids[at]);
+    ids.erase(ids.begin() + at);
+    put_directory(*(BlockID *) directory.data, ids.data(), count - 1);
+    save();
+    return true;
+}
+
+// For a bulk load: put the next (key, handle) pair, in key order, at the end, if the leaf stays within
+// limit bytes. An empty leaf takes one regardless. Not saved until save().
+bool BTreeLeaf::append(const KeyValue *key, Handle handle, uint32_t limit) {
+    Dbt *dbt = marshal_entry(key, handle);
+    uint32_t room = page()->largest_addable(), needed = dbt->get_size() + sizeof(RecordID);
+    bool fits = (room >= needed && this->file.get_block_size() - room + needed <= limit) || size() == 0;
+    if (fits)
+        add_entry(size(), dbt);
+    delete[] (char *) dbt->get_data();
+    delete dbt;
+    return fits;
+}
+
+// The entry in which key is to be found: the first whose key is no less than key (size() if none is). A
+// binary search through the directory, like BTreeInterior::child_index, comparing the marshaled keys in place.
+uint BTreeLeaf::lower_bound(const KeyValue *key) const {
+    RecordView directory = page()->view(DIRECTORY);
+    const RecordID *ids = (const RecordID *) (directory.data + sizeof(BlockID));
+    uint base = 0, len = (directory.size - sizeof(BlockID)) / sizeof(RecordID);
+    if (len == 0)
+        return 0;
+    while (len > 1) {
+        uint half = len / 2;
+        base += compare(page()->view(ids[base + half]).data + HANDLE_SZ, key) < 0 ? half : 0;
+        len -= half;
     }
+    return base + (compare(page()->view(ids[base]).data + HANDLE_SZ, key) < 0 ? 1 : 0);
 }
 
+// Compare a marshaled key to key, in the same order as KeyValue's: negative, zero, or positive as the
+// marshaled one is less, equal, or greater. Only decodes as far as the first column that differs.
+int BTreeLeaf::compare(const char *bytes, const KeyValue *key) const {
+    uint col_num = 0;
+    for (auto const &data_type: this->key_profile) {
+        const Value &value = (*key)[col_num++];
+        if (data_type == ColumnAttribute::DataType::INT) {
+            int32_t n = *(int32_t *) bytes;
+            bytes += sizeof(int32_t);
+            if (n != value.get_int())
+                return n < value.get_int() ? -1 : 1;
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            uint32_t size = *(uint16_t *) bytes, other_size = value.text_size();
+            bytes += sizeof(uint16_t);
+            int cmp = memcmp(bytes, value.text_data(), min(size, other_size));
+            bytes += size;
+            if (cmp != 0)
+                return cmp;
+            if (size != other_size)
+                return size < other_size ? -1 : 1;
+        } else {
+            int32_t b = *(uint8_t *) bytes;
+            bytes += sizeof(uint8_t);
+            if (b != value.get_int())
+                return b < value.get_int() ? -1 : 1;
+        }
+    }
+    return 0;
+}
 
+// Convert a key, handle pair into the bytes of a leaf entry: the handle, then the key.
+Dbt *BTreeLeaf::marshal_entry(const KeyValue *key, Handle handle) {
+    Dbt *key_dbt = marshal_key(key);
+    uint32_t size = HANDLE_SZ + key_dbt->get_size();
+    char *bytes = new char[size];
+    *(BlockID *) bytes = handle.first;
+    *(RecordID *) (bytes + sizeof(BlockID)) = handle.second;
+    memcpy(bytes + HANDLE_SZ, key_dbt->get_data(), key_dbt->get_size());
+    delete[] (char *) key_dbt->get_data();
+    delete key_dbt;
+    return new Dbt(bytes, size);
+}
+
+// Add an entry (made by marshal_entry) as a record and put its id into the directory at at. The caller has
+// made sure there is room for both.
+void BTreeLeaf::add_entry(uint at, const Dbt *entry) {
+    RecordID record_id = page()->add(entry);
+    RecordView directory = page()->view(DIRECTORY);
+    uint count = (directory.size - sizeof(BlockID)) / sizeof(RecordID);
+    std::vector<RecordID> ids((const RecordID *) (directory.data + sizeof(BlockID)),
+                              (const RecordID *) (directory.data + sizeof(BlockID)) + count);
+    ids.insert(ids.begin() + at, record_id);
+    put_directory(*(BlockID *) directory.data, ids.data(), count + 1);
+}
+
+// Write the directory record: the next leaf pointer, then the entries' record ids in key order.
+void BTreeLeaf::put_directory(BlockID next_leaf, const RecordID *ids, uint count) {
+    uint32_t size = sizeof(BlockID) + count * sizeof(RecordID);
+    char *bytes = new char[size];
+    *(BlockID *) bytes = next_leaf;
+    if (count > 0)
+        memcpy(bytes + sizeof(BlockID), ids, count * sizeof(RecordID));
+    Dbt dbt(bytes, size);
+    if (page()->size() == 0)
+        page()->add(&dbt);  // a new leaf: the directory is always record 1
+    else
+        page()->put(DIRECTORY, dbt);
+    delete[] bytes;
+}
@@ -4,6 +4,7 @@
  * @see "Seattle University, CPSC5300, Winter Quarter 2024"
  */
 
+#include <map>
 #include "EvalPlan.h"
 
 
@@ -43,24 +44,66 @@ public:
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names) { return nullptr; }
 };
 
+/**
+ * Put a handle list in heap order for a bitmap heap scan: mark each handle in a bitmap of record ids
+ * kept per block, then read the bitmaps back in block id order. Whatever fetches the records then
+ * gets all of a block's records together and the blocks in file order, each once. Duplicate handles
+ * (as from overlapping index ranges) come out only once.
+ * @param handles  in any order
+ * @returns        the same handles, sorted by block and record id
+ */
+static Handles *bitmap_order(const Handles *handles) {
+    std::map<BlockID, std::vector<bool>> bitmaps;
+    for (auto const &handle: *handles) {
+        std::vector<bool> &bitmap = bitmaps[handle.first];
+        if (bitmap.size() <= handle.second)
+            bitmap.resize(handle.second + 1);
+        bitmap[handle.second] = true;
+    }
+    Handles *ordered = new Handles();
+    ordered->reserve(handles->size());
+    for (auto const &bitmap: bitmaps)
+        for (size_t record_id = 0; record_id < bitmap.second.size(); record_id++)
+            if (bitmap.second[record_id])
+                ordered->push_back(Handle(bitmap.first, (RecordID) record_id));
+    return ordered;
+}
+
 EvalPlan::EvalPlan(PlanType type, EvalPlan *relation) : type(type), relation(relation), projection(nullptr),
-                                                        select_conjunction(nullptr), table(Dummy::one()) {
+                                                        select_conjunction(nullptr), table(Dummy::one()),
+                                                        index(nullptr), min_key(nullptr), max_key(nullptr) {
 }
 
 EvalPlan::EvalPlan(ColumnNames *projection, EvalPlan *relation) : type(Project), relation(relation),
                                                                   projection(projection), select_conjunction(nullptr),
-                                                                  table(Dummy::one()) {
+                                                                  table(Dummy::one()), index(nullptr),
+                                                                  min_key(nullptr), max_key(nullptr) {
 }
 
 EvalPlan::EvalPlan(ValueDict *conjunction, EvalPlan *relation) : type(Select), relation(relation), projection(nullptr),
-                                                                 select_conjunction(conjunction), table(Dummy::one()) {
+                                                                 select_conjunction(conjunction), table(Dummy::one()),
+                                                                 index(nullptr), min_key(nullptr), max_key(nullptr) {
 }
 
 EvalPlan::EvalPlan(DbRelation &table) : type(TableScan), relation(nullptr), projection(nullptr),
-                                        select_conjunction(nullptr), table(table) {
+                                        select_conjunction(nullptr), table(table), index(nullptr), min_key(nullptr),
+                                        max_key(nullptr) {
+}
+
+EvalPlan::EvalPlan(DbIndex &index, ValueDict *key) : type(IndexScan), relation(nullptr), projection(nullptr),
+                                                     select_conjunction(nullptr), table(index.get_relation()),
+                                                     index(&index), min_key(key), max_key(nullptr) {
+}
+
+EvalPlan::EvalPlan(DbIndex &index, ValueDict *min_key, ValueDict *max_key) : type(IndexScan), relation(nullptr),
+                                                                             projection(nullptr),
+                                                                             select_conjunction(nullptr),
+                                                                             table(index.get_relation()),
+                                                                             index(&index), min_key(min_key),
+                                                                             max_key(max_key) {
 }
 
-EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), table(other->table) {
+EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), table(other->table), index(other->index) {
     if (other->relation != nullptr)
         relation = new EvalPlan(other->relation);
     else
@@ -73,21 +116,36 @@ EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), table(other->tabl
         select_conjunction = new ValueDict(*other->select_conjunction);
     else
         select_conjunction = nullptr;
+    if (other->min_key != nullptr)
+        min_key = new ValueDict(*other->min_key);
+    else
+        min_key = nullptr;
+    if (other->max_key != nullptr)
+        max_key = new ValueDict(*other->max_key);
+    else
+        max_key = nullptr;
 }
 
 EvalPlan::~EvalPlan() {
     delete relation;
     delete projection;
     delete select_conjunction;
+    delete min_key;
+    delete max_key;
 }
 
 
 EvalPlan *EvalPlan::optimize() {
-    return new EvalPlan(this);  // For now, we don't know how to do anything better
+    EvalPlan *ret = new EvalPlan(this);
+    // an index hands back its handles in key order; put a bitmap heap scan above it so the heap is read in block order
+    for (EvalPlan *plan = ret; plan->relation != nullptr; plan = plan->relation)
+        if (plan->type != BitmapHeapScan && plan->relation->type == IndexScan)
+            plan->relation = new EvalPlan(BitmapHeapScan, plan->relation);
+    return ret;
 }
 
-ValueDicts *EvalPlan::evaluate() {
-    ValueDicts *ret = nullptr;
+RowSet *EvalPlan::evaluate(Arena *arena) {
+    RowSet *ret = nullptr;
     if (this->type != ProjectAll && this->type != Project)
         throw DbRelationError("Invalid evaluation plan--not ending with a projection");
 
@@ -95,9 +153,9 @@ ValueDicts *EvalPlan::evaluate() {
     DbRelation *temp_table = pipeline.first;
     Handles *handles = pipeline.second;
     if (this->type == ProjectAll)
-        ret = temp_table->project(handles);
+        ret = temp_table->project_rows(handles, nullptr, arena);
     else if (this->type == Project)
-        ret = temp_table->project(handles, this->projection);
+        ret = temp_table->project_rows(handles, this->projection, arena);
     delete handles;
     return ret;
 }
@@ -108,8 +166,19 @@ EvalPipeline EvalPlan::pipeline() {
         return EvalPipeline(&this->table, this->table.select());
     if (this->type == Select && this->relation->type == TableScan)
         return EvalPipeline(&this->relation->table, this->relation->table.select(this->select_conjunction));
+    if (this->type == IndexScan) {
+        if (this->max_key == nullptr)
+            return EvalPipeline(&this->table, this->index->lookup(this->min_key));
+        return EvalPipeline(&this->table, this->index->range(this->min_key, this->max_key));
+    }
 
-    // recursive case
+    // recursive cases
+    if (this->type == BitmapHeapScan) {
+        EvalPipeline pipeline = this->relation->pipeline();
+        EvalPipeline ret(pipeline.first, bitmap_order(pipeline.second));
+        delete pipeline.second;
+        return ret;
+    }
     if (this->type == Select) {
         EvalPipeline pipeline = this->relation->pipeline();
         DbRelation *temp_table = pipeline.first;
@@ -119,7 +188,7 @@ EvalPipeline EvalPlan::pipeline() {
         return ret;
     }
 
-    throw DbRelationError("Not implemented: pipeline other than Select or TableScan");
+    throw DbRelationError("Not implemented: pipeline other than Select, TableScan, IndexScan, or BitmapHeapScan");
 }
 
 
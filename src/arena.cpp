@@ -0,0 +1,87 @@
+/**
+ * @file arena.cpp - implementation of Arena
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#include <cstdint>
+#include <cstring>
+#include "arena.h"
+
+using namespace std;
+
+const size_t Arena::CHUNK_SZ;
+const size_t Arena::MAX_FREE_CHUNKS;
+std::mutex Arena::free_latch;
+
+// spent chunks waiting for another arena (the ones still here at exit are freed then)
+std::vector<char *> &Arena::free_chunks() {
+    static struct FreeChunks : vector<char *> {
+        ~FreeChunks() {
+            for (auto chunk: *this)
+                delete[] chunk;
+        }
+    } all;
+    return all;
+}
+
+/**
+ * Give back everything: the chunks go on the free list (as far as it has room), big blocks are freed.
+ */
+Arena::~Arena() {
+    for (auto block: this->big)
+        delete[] block;
+    lock_guard<mutex> lock(free_latch);
+    for (auto chunk: this->chunks) {
+        if (free_chunks().size() < MAX_FREE_CHUNKS)
+            free_chunks().push_back(chunk);
+        else
+            delete[] chunk;
+    }
+}
+
+/**
+ * Get some memory that lasts as long as the arena.
+ * @param size       number of bytes
+ * @param alignment  power of two the address has to be a multiple of
+ * @returns          the memory (never freed by caller)
+ */
+void *Arena::allocate(size_t size, size_t alignment) {
+    this->size += size;
+    if (size + alignment > CHUNK_SZ / 4) {
+        // big enough to waste a lot of a chunk; give it its own block (new[] is aligned for anything)
+        char *block = new char[size];
+        this->big.push_back(block);
+        return block;
+    }
+    uintptr_t at = ((uintptr_t) this->next + alignment - 1) & ~(uintptr_t) (alignment - 1);
+    if (this->next == nullptr || at + size > (uintptr_t) this->end) {
+        char *chunk = nullptr;
+        {
+            lock_guard<mutex> lock(free_latch);
+            if (!free_chunks().empty()) {
+                chunk = free_chunks().back();
+                free_chunks().pop_back();
+            }
+        }
+        if (chunk == nullptr)
+            chunk = new char[CHUNK_SZ];
+        this->chunks.push_back(chunk);
+        this->next = chunk;
+        this->end = chunk + CHUNK_SZ;
+        at = ((uintptr_t) this->next + alignment - 1) & ~(uintptr_t) (alignment - 1);
+    }
+    this->next = (char *) (at + size);
+    return (void *) at;
+}
+
+/**
+ * Copy some bytes into the arena.
+ * @param data  the bytes
+ * @param size  how many
+ * @returns     the copy
+ */
+char *Arena::copy(const char *data, size_t size) {
+    char *bytes = static_cast<char *>(allocate(size, 1));
+    memcpy(bytes, data, size);
+    return bytes;
+}
@@ -3,42 +3,65 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Winter Quarter 2024"
  */
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
 #include "btree.h"
+#include "EvalPlan.h"
 
-BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique) : DbIndex(relation,
-                                                                                                              name,
-                                                                                                              key_columns,
-                                                                                                              unique),
-                                                                                                      closed(true),
-                                                                                                      stat(nullptr),
-                                                                                                      root(nullptr),
-                                                                                                      file(relation.get_table_name() +
-                                                                                                           "-" + name),
-                                                                                                      key_profile() {
+// block_size is the size of the index file's blocks if it gets created (bigger blocks give a shallower tree);
+// fill_percent is how full create() packs each node (leaving the rest for later inserts before they split)
+BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique, uint block_size,
+                       uint fill_percent)
+        : DbIndex(relation, name, key_columns, unique),
+          closed(true),
+          stat(nullptr),
+          file(relation.get_table_name() + "-" + name, block_size),
+          key_profile(),
+          fill_percent(fill_percent) {
     if (!unique)
         throw DbRelationError("BTree index must have unique key");
+    if (fill_percent == 0 || fill_percent > 100)
+        throw DbRelationError("BTree fill factor must be from 1 to 100 percent");
     build_key_profile();
 }
 
 BTreeIndex::~BTreeIndex() {
+    uncache();
     delete stat;
-    delete root;
 }
 
-// Create the index.
+// Create the index. The keys of the rows already in the relation are pulled out and sorted, then the tree is
+// built from them bottom up.
 void BTreeIndex::create() {
+    uncache();
     file.create();
     stat = new BTreeStat(file, STAT, STAT + 1, key_profile);
-    root = new BTreeLeaf(file, stat->get_root_id(), key_profile, true);
     closed = false;
     Handles *table_rows = relation.select();
-    for (auto const &row: *table_rows)
-        insert(row);
+    IndexEntries *entries = sorted_entries(table_rows);
     delete table_rows;
+    try {
+        for (uint i = 1; i < entries->size(); i++)
+            if ((*entries)[i - 1].first == (*entries)[i].first)
+                throw DbRelationError("Duplicate keys are not allowed in unique index");
+        if (entries->empty()) {
+            auto *root = new BTreeLeaf(file, stat->get_root_id(), key_profile, true);
+            root->save();
+            delete root;
+        } else
+            bulk_load(entries);
+    } catch (...) {
+        delete entries;
+        throw;
+    }
+    delete entries;
 }
 
 // Drop the index.
 void BTreeIndex::drop() {
+    close();
     file.drop();
 }
 
@@ -47,22 +70,17 @@ void BTreeIndex::open() {
     if (closed) {
         file.open();
         stat = new BTreeStat(file, STAT, key_profile);
-        if (stat->get_height() == 1)
-            root = new BTreeLeaf(file, stat->get_root_id(), key_profile, false);
-        else
-            root = new BTreeInterior(file, stat->get_root_id(), key_profile, false);
-        closed = true;
+        closed = false;
     }
 }
 
 // Closes the index. Disables: lookup, range, insert, delete, update.
 void BTreeIndex::close() {
     if (!closed) {
-        file.close();
-        delete stat;
+        delete stat;  // nodes have to let go of their blocks before the file goes away
         stat = nullptr;
-        delete root;
-        root = nullptr;
+        uncache();
+        file.close();
         closed = true;
     }
 }
@@ -70,14 +88,18 @@ void BTreeIndex::close() {
 // Find all the rows whose columns are equal to key. Assumes key is a dictionary whose keys are the column
 // names in the index. Returns a list of row handles.
 Handles *BTreeIndex::lookup(ValueDict *key_dict) const {
-    return _lookup(this->root, this->stat->get_height(), this->tkey(key_dict));
+    KeyValue *key = this->tkey(key_dict);
+    Handles *results = _lookup(node(stat->get_root_id(), stat->get_height()), stat->get_height(), key);
+    delete key;
+    return results;
 }
 
 Handles* BTreeIndex::_lookup(BTreeNode* node, uint height, const KeyValue* key) const {
     // check if the nod is a leaf node
     if (!dynamic_cast<BTreeLeaf*>(node)) {
         // continue looking at a lower lefel
-        return this->_lookup(dynamic_cast<const BTreeInterior*>(node)->find(key, height), height - 1, key);
+        BTreeNode *child = this->node(dynamic_cast<const BTreeInterior*>(node)->find(key), height - 1);
+        return this->_lookup(child, height - 1, key);
     }
 
     // if it's leaf then no more levels to search
@@ -88,21 +110,155 @@ Handles* BTreeIndex::_lookup(BTreeNode* node, uint height, const KeyValue* key)
     catch (...) {
 
     }
+    node->unpin();
     return results;
 }
 
+// Find all the rows whose keys are from min_key to max_key, both inclusive (either can be nullptr for no bound on
+// that side). Returns a list of row handles in key order.
 Handles *BTreeIndex::range(ValueDict *min_key, ValueDict *max_key) const {
-    throw DbRelationError("Don't know how to do a range query on Btree index yet");
-    // FIXME
+    Handles *results = new Handles();
+    for (BTreeCursor cursor = this->cursor(min_key, true, max_key, true); !cursor.at_end();)
+        results->push_back(cursor.next());
+    return results;
+}
+
+// Get a cursor over the rows whose keys are from min_key to max_key, in key order. Either bound can be nullptr
+// for no bound on that side, and each is inclusive or not. The tree is descended once, to the first entry in
+// the range (or the leftmost leaf if there is no lower bound); the cursor takes it from there.
+BTreeCursor BTreeIndex::cursor(const ValueDict *min_key, bool min_inclusive, const ValueDict *max_key,
+                               bool max_inclusive) const {
+    BlockID leaf_id;
+    uint at = 0;
+    if (min_key == nullptr) {
+        uint height = stat->get_height();
+        BTreeNode *node = this->node(stat->get_root_id(), height);
+        for (; height > 1; height--)
+            node = this->node(dynamic_cast<BTreeInterior *>(node)->get_first(), height - 1);
+        leaf_id = node->get_id();
+    } else {
+        KeyValue *tmin = this->tkey(min_key);
+        BTreeLeaf *leaf = find_leaf(tmin);
+        leaf_id = leaf->get_id();
+        at = leaf->lower_bound(tmin);
+        if (!min_inclusive && at < leaf->size() && leaf->compare_at(at, tmin) == 0)
+            at++;
+        leaf->unpin();
+        delete tmin;
+    }
+    KeyValue *tmax = max_key == nullptr ? nullptr : this->tkey(max_key);
+    BTreeCursor cursor(*this, leaf_id, at, tmax, max_inclusive);
+    delete tmax;
+    return cursor;
 }
 
 // Insert a row with the given handle. Row must exist in relation already.
 void BTreeIndex::insert(Handle handle) {
     open();
-    ValueDict *key = relation.project(handle);
+    ValueDict *key = relation.project(handle, &key_columns);
     KeyValue *tkey = this->tkey(key);
+    insert_key(tkey, handle);
+    delete key;
+    delete tkey;
+}
+
+// Insert a batch of rows (which must exist in relation already). All the keys are pulled out first and
+// then inserted in key order, so consecutive inserts go down the same, already cached, path of nodes. If one
+// fails (a duplicate, say), the ones already in are taken out again.
+void BTreeIndex::insert_batch(const Handles *handles) {
+    open();
+    IndexEntries *entries = sorted_entries(handles);
+    size_t done = 0;
+    try {
+        for (; done < entries->size(); done++)
+            insert_key(&(*entries)[done].first, (*entries)[done].second);
+    } catch (...) {
+        for (size_t i = 0; i < done; i++)
+            find_leaf(&(*entries)[i].first)->del(&(*entries)[i].first);  // del() saves, so unpins
+        delete entries;
+        throw;
+    }
+    delete entries;
+}
+
+// Pull out the keys of the given rows (the relation reads them a block at a time) and sort them.
+IndexEntries *BTreeIndex::sorted_entries(const Handles *handles) const {
+    RowSet *rows = relation.project_rows(const_cast<Handles *>(handles), &key_columns);
+    IndexEntries *entries = new IndexEntries();
+    entries->reserve(rows->size());
+    for (size_t i = 0; i < rows->size(); i++) {
+        const Row &row = (*rows)[i];
+        entries->push_back(std::make_pair(KeyValue(row.size()), (*handles)[i]));
+        for (size_t col_num = 0; col_num < row.size(); col_num++)
+            entries->back().first[col_num] = row[col_num];
+    }
+    delete rows;
+    std::sort(entries->begin(), entries->end(),
+              [](const std::pair<KeyValue, Handle> &a, const std::pair<KeyValue, Handle> &b) {
+                  return a.first < b.first;
+              });
+    return entries;
+}
+
+// Build the tree bottom up from entries sorted by key (at least one, no duplicates). The leaves are packed left
+// to right, each up to fill_percent full, then a level of interior nodes over them the same way, and so on up
+// until one node is left, which is the root. Each node is written once.
+void BTreeIndex::bulk_load(const IndexEntries *entries) {
+    uint32_t limit = (uint32_t) ((uint64_t) file.get_block_size() * fill_percent / 100);
+
+    // the nodes of the level just built, each with the lowest key under it
+    std::vector<std::pair<BlockID, const KeyValue *>> level;
+    auto *leaf = new BTreeLeaf(file, 0, key_profile, true);
+    level.push_back(std::make_pair(leaf->get_id(), &entries->front().first));
+    for (auto const &entry: *entries) {
+        if (leaf->append(&entry.first, entry.second, limit))
+            continue;
+        auto *next = new BTreeLeaf(file, 0, key_profile, true);
+        leaf->set_next_leaf(next->get_id());
+        leaf->save();
+        delete leaf;
+        leaf = next;
+        level.push_back(std::make_pair(leaf->get_id(), &entry.first));
+        leaf->append(&entry.first, entry.second, limit);
+    }
+    leaf->save();
+    delete leaf;
+
+    uint height = 1;
+    while (level.size() > 1) {
+        std::vector<std::pair<BlockID, const KeyValue *>> parents;
+        BTreeInterior *node = nullptr;
+        for (auto const &child: level) {
+            if (node != nullptr && node->append(child.second, child.first, limit))
+                continue;
+            if (node != nullptr) {
+                node->save();
+                delete node;
+            }
+            node = new BTreeInterior(file, 0, key_profile, true);
+            node->set_first(child.first);
+            parents.push_back(std::make_pair(node->get_id(), child.second));
+        }
+        node->save();
+        delete node;
+        level.swap(parents);
+        height++;
+    }
+
+    stat->set_root_id(level.front().first);
+    stat->set_height(height);
+    stat->save();
+}
+
+// Insert one key into the tree, growing a new root if the old one splits.
+void BTreeIndex::insert_key(const KeyValue *tkey, Handle handle) {
+    BTreeNode *root = node(stat->get_root_id(), stat->get_height());
     Insertion insertion = _insert(root, stat->get_height(), tkey, handle);
     if (!BTreeNode::insertion_is_none(insertion)) {
+        if (stat->get_height() == 1) {  // the old root is just one of the leaves now
+            resident.erase(root->get_id());
+            cache_leaf(dynamic_cast<BTreeLeaf *>(root));
+        }
         auto *new_root = new BTreeInterior(file, 0, key_profile, true);
         new_root->set_first(root->get_id());
         new_root->insert(&insertion.second, insertion.first);
@@ -110,31 +266,104 @@ void BTreeIndex::insert(Handle handle) {
         stat->set_root_id(new_root->get_id());
         stat->set_height(stat->get_height() + 1);
         stat->save();
-        delete root;
-        root = new_root;
+        resident[new_root->get_id()] = new_root;
         std::cout << "new root: " << *new_root << std::endl;
     }
-    delete key;
-    delete tkey;
 }
 
 // Recursive insert. If a split happens at this level, return the (new node, boundary) of the split.
 Insertion BTreeIndex::_insert(BTreeNode *node, uint height, const KeyValue *key, Handle handle) {
     if (height == 1) {
         auto *leaf = dynamic_cast<BTreeLeaf *>(node);
-        return leaf->insert(key, handle);
+        try {
+            return leaf->insert(key, handle);  // saves, so unpins, unless it throws
+        } catch (...) {
+            leaf->unpin();
+            throw;
+        }
     } else {
         auto *interior = dynamic_cast<BTreeInterior *>(node);
-        Insertion insertion = _insert(interior->find(key, height), height - 1, key, handle);
+        BTreeNode *child = this->node(interior->find(key), height - 1);
+        Insertion insertion = _insert(child, height - 1, key, handle);
         if (!BTreeNode::insertion_is_none(insertion))
             insertion = interior->insert(&insertion.second, insertion.first);
         return insertion;
     }
 }
 
+// The decoded node in the given block (height 1 for a leaf), read in if we don't have it. The root and the interior
+// nodes are kept for as long as the index is open, so a descent only decodes the leaf, if that; up to CACHED_LEAVES
+// leaves are kept as well, the least recently used going first. The nodes don't keep their blocks pinned: whoever looks
+// into a leaf unpins it when done, and a change saves (and so unpins) it. A node is only ever changed through the
+// object here, so a split leaves everything here as it should be (the new sibling is read in when it is first reached);
+// anything that rewrites the file behind the cache's back (create) empties it first.
+BTreeNode *BTreeIndex::node(BlockID block_id, uint height) const {
+    HeapFile &file = const_cast<HeapFile &>(this->file);  // only to read the node in
+    auto found = resident.find(block_id);
+    if (found != resident.end())
+        return found->second;
+    if (height > 1 || block_id == stat->get_root_id()) {
+        BTreeNode *node;
+        if (height > 1)
+            node = new BTreeInterior(file, block_id, key_profile, false);
+        else
+            node = new BTreeLeaf(file, block_id, key_profile, false);
+        resident[block_id] = node;
+        return node;
+    }
+
+    auto cached = leaf_index.find(block_id);
+    if (cached != leaf_index.end()) {
+        leaves.splice(leaves.begin(), leaves, cached->second);
+        return leaves.front();
+    }
+    return cache_leaf(new BTreeLeaf(file, block_id, key_profile, false));
+}
+
+// Keep a decoded leaf as the most recently used, letting go of the least recently used if there are too many.
+BTreeLeaf *BTreeIndex::cache_leaf(BTreeLeaf *leaf) const {
+    if (leaves.size() >= CACHED_LEAVES) {
+        BTreeLeaf *victim = leaves.back();
+        leaf_index.erase(victim->get_id());
+        leaves.pop_back();
+        delete victim;
+    }
+    leaves.push_front(leaf);
+    leaf_index[leaf->get_id()] = leaves.begin();
+    return leaf;
+}
+
+// Throw away all the decoded nodes.
+void BTreeIndex::uncache() {
+    for (auto const &item: resident)
+        delete item.second;
+    resident.clear();
+    for (auto leaf: leaves)
+        delete leaf;
+    leaves.clear();
+    leaf_index.clear();
+}
+
+// Remove the index entry for the given row, which must still be in the relation. The entry is taken out of its
+// leaf in place; a leaf that empties out stays in the tree.
 void BTreeIndex::del(Handle handle) {
-    throw DbRelationError("Don't know how to delete from a BTree index yet");
-    // FIXME
+    open();
+    ValueDict *key = relation.project(handle, &key_columns);
+    KeyValue *tkey = this->tkey(key);
+    delete key;
+    BTreeLeaf *leaf = find_leaf(tkey);
+    if (!leaf->del(tkey))
+        leaf->unpin();  // del() only saves if it took something out
+    delete tkey;
+}
+
+// The leaf where key is (or would go).
+BTreeLeaf *BTreeIndex::find_leaf(const KeyValue *key) const {
+    uint height = stat->get_height();
+    BTreeNode *node = this->node(stat->get_root_id(), height);
+    for (; height > 1; height--)
+        node = this->node(dynamic_cast<BTreeInterior *>(node)->find(key), height - 1);
+    return dynamic_cast<BTreeLeaf *>(node);
 }
 
 KeyValue *BTreeIndex::tkey(const ValueDict *key) const {
@@ -157,6 +386,30 @@ void BTreeIndex::build_key_profile() {
         key_profile.push_back(types_by_colname[column_name]);
 }
 
+// A BTreeIndex whose node cache the tests can look into.
+class BTreeIndexProbe : public BTreeIndex {
+public:
+    using BTreeIndex::BTreeIndex;
+
+    // Number of decoded nodes still holding on to their blocks (there should be none between calls).
+    uint pinned() const {
+        uint count = 0;
+        for (auto const &item: resident)
+            count += item.second->is_pinned() ? 1 : 0;
+        for (auto leaf: leaves)
+            count += leaf->is_pinned() ? 1 : 0;
+        return count;
+    }
+
+    // Number of leaves kept for as long as the index is open (only the root, if it is a leaf, should be).
+    uint resident_leaves() const {
+        uint count = 0;
+        for (auto const &item: resident)
+            count += item.first != stat->get_root_id() && dynamic_cast<BTreeLeaf *>(item.second) ? 1 : 0;
+        return count;
+    }
+};
+
 bool test_btree() {
     ColumnNames column_names;
     column_names.push_back("a");
@@ -181,7 +434,7 @@ bool test_btree() {
     }
     column_names.clear();
     column_names.push_back("a");
-    BTreeIndex index(table, "fooindex", column_names, true);
+    BTreeIndexProbe index(table, "fooindex", column_names, true);
     index.create();
     std::cout << "successful btree insertion " << std::endl;
     // return true;  // FIXME    
@@ -233,8 +486,181 @@ bool test_btree() {
             delete result;
         }
 
+    if (index.pinned() != 0) {
+        std::cout << "lookups left leaves pinned" << std::endl;
+        return false;
+    }
     std::cout << "successful btree lookup" << std::endl;
-    return true; // since delete is not yet implemented
+
+    // index scan under a select and a projection: the optimizer puts a bitmap heap scan in between
+    lookup["a"] = 105;
+    ValueDict *where = new ValueDict();
+    (*where)["b"] = -5;
+    EvalPlan *plan = new EvalPlan(EvalPlan::ProjectAll,
+                                  new EvalPlan(where, new EvalPlan(index, new ValueDict(lookup))));
+    EvalPlan *optimized = plan->optimize();
+    RowSet *rows = optimized->evaluate();
+    bool ok = rows->size() == 1 && (*rows)[0].at("a") == Value(105) && (*rows)[0].at("b") == Value(-5);
+    delete rows;
+    (*where)["b"] = 5;
+    rows = optimized->evaluate();  // the plan it was copied from is untouched
+    ok = ok && rows->size() == 1;
+    delete rows;
+    delete optimized;
+    optimized = plan->optimize();
+    rows = optimized->evaluate();
+    ok = ok && rows->size() == 0;
+    delete rows;
+    delete optimized;
+    delete plan;
+    if (!ok) {
+        std::cout << "index scan plan failed" << std::endl;
+        return false;
+    }
+
+    // bulk load at a lower fill factor, then keep inserting into the half-full leaves
+    column_names.clear();
+    column_names.push_back("b");
+    BTreeIndex bindex(table, "barindex", column_names, true, DbBlock::BLOCK_SZ, 50);
+    bindex.create();
+    for (int i = 0; i < 100; i++) {
+        ValueDict row;
+        row["a"] = Value(-i - 1);
+        row["b"] = Value(1000 + i);
+        Handle handle = table.insert(&row);
+        bindex.insert(handle);
+        index.insert(handle);
+    }
+    ValueDict blookup;
+    for (int i = 0; ok && i < 100 * 1000; i += 997) {
+        blookup["b"] = -i;
+        handles = bindex.lookup(&blookup);
+        ok = handles->size() == 1;
+        if (ok) {
+            result = table.project(handles->back());
+            ok = (*result)["a"] == Value(i + 100);
+            delete result;
+        }
+        delete handles;
+    }
+    // the same again from the file instead of the cached nodes
+    for (bool reopen: {false, true}) {
+        if (reopen) {
+            bindex.close();
+            bindex.open();
+        }
+        for (int b: {99, 101, 1000, 1050, 1099, -99999}) {
+            blookup["b"] = b;
+            handles = bindex.lookup(&blookup);
+            ok = ok && handles->size() == 1;
+            delete handles;
+        }
+    }
+    bindex.drop();
+    if (!ok) {
+        std::cout << "bulk loaded lookup failed" << std::endl;
+        return false;
+    }
+
+    // small blocks and full nodes, so inserts in random order split leaves and interior nodes all over
+    ColumnNames k_names = {"k"};
+    ColumnAttributes k_attributes = {ColumnAttribute(ColumnAttribute::INT)};
+    HeapTable ktable("__test_btree_split", k_names, k_attributes);
+    ktable.create();
+    BTreeIndexProbe grown(ktable, "grown", k_names, true, 512, 100);  // from a lone root leaf, by inserts alone
+    grown.create();
+    for (int k = 0; k < 4000; k += 2) {
+        ValueDict row;
+        row["k"] = Value(k);
+        grown.insert(ktable.insert(&row));
+    }
+    ok = grown.resident_leaves() == 0 && grown.pinned() == 0;
+    grown.drop();
+    if (!ok) {
+        std::cout << "grown index kept an old root leaf or a pin" << std::endl;
+        return false;
+    }
+    BTreeIndex kindex(ktable, "kindex", k_names, true, 512, 100);
+    kindex.create();
+    std::vector<int> odd;
+    for (int k = 1; k < 4000; k += 2)
+        odd.push_back(k);
+    std::shuffle(odd.begin(), odd.end(), std::mt19937(5300));
+    std::map<int, Handle> k_handles;
+    for (int k: odd) {
+        ValueDict row;
+        row["k"] = Value(k);
+        k_handles[k] = ktable.insert(&row);
+        kindex.insert(k_handles[k]);
+    }
+    for (int k: odd)
+        if (k % 4 == 1)
+            kindex.del(k_handles[k]);
+    ValueDict klookup;
+    for (bool reopen: {false, true}) {
+        if (reopen) {
+            kindex.close();
+            kindex.open();
+        }
+        for (int k = -1; ok && k <= 4000; k++) {
+            klookup["k"] = Value(k);
+            handles = kindex.lookup(&klookup);
+            bool there = k >= 0 && k < 4000 && k % 4 != 1;
+            ok = handles->size() == (there ? 1U : 0U);
+            if (ok && there) {
+                result = ktable.project(handles->back());
+                ok = (*result)["k"] == Value(k);
+                delete result;
+            }
+            delete handles;
+        }
+    }
+    kindex.drop();
+    ktable.drop();
+    if (!ok) {
+        std::cout << "split and delete failed" << std::endl;
+        return false;
+    }
+
+    // TEXT keys of very different lengths: a full leaf of two long keys and eight short ones gets a third long
+    // key at the front. Split by count, the lower half would keep both long keys and have no room for it.
+    ColumnNames t_names = {"t"};
+    ColumnAttributes t_attributes = {ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable ttable("__test_btree_text", t_names, t_attributes);
+    ttable.create();
+    BTreeIndex tindex(ttable, "tindex", t_names, true, 512, 100);
+    tindex.create();
+    std::vector<std::string> texts = {"A1", "A2"};
+    for (int i = 0; i < 8; i++)
+        texts.push_back("b00" + std::to_string(i));
+    texts.push_back("A0");
+    for (auto &text: texts)
+        if (text[0] == 'A')
+            text += std::string(148, '.');
+    try {
+        for (auto const &text: texts) {
+            ValueDict row;
+            row["t"] = Value(text);
+            tindex.insert(ttable.insert(&row));
+        }
+    } catch (DbBlockNoRoomError &e) {
+        ok = false;
+    }
+    ValueDict tlookup;
+    for (auto const &text: texts) {
+        if (!ok)
+            break;
+        tlookup["t"] = Value(text);
+        handles = tindex.lookup(&tlookup);
+        ok = handles->size() == 1;
+        delete handles;
+    }
+    tindex.drop();
+    ttable.drop();
+    if (!ok) {
+        std::cout << "variable length split failed" << std::endl;
+        return false;
+    }
 
     // test delete
     ValueDict row;
@@ -261,6 +687,33 @@ bool test_btree() {
     }
     delete handles;
 
+    // a batch with a duplicate in it does not go in at all
+    Handles batch;
+    for (int a: {-500, -501, 12}) {  // 12 is row1's
+        row["a"] = a;
+        batch.push_back(table.insert(&row));
+    }
+    bool refused = false;
+    try {
+        index.insert_batch(&batch);
+    } catch (DbRelationError &e) {
+        refused = true;
+    }
+    lookup["a"] = -501;
+    handles = index.lookup(&lookup);
+    bool left_behind = !handles->empty();
+    delete handles;
+    lookup["a"] = 12;
+    handles = index.lookup(&lookup);
+    bool kept = handles->size() == 1 && handles->back() != batch.back();
+    delete handles;
+    for (auto const &handle: batch)
+        table.del(handle);
+    if (!refused || left_behind || !kept) {
+        std::cout << "failed batch not taken back" << std::endl;
+        return false;
+    }
+
     // test range
     ValueDict minkey, maxkey;
     minkey["a"] = 100;
@@ -270,7 +723,7 @@ bool test_btree() {
     for (int i = 0; i < 210; i++) {
         if (results->at(i)->at("a") != Value(100 + i)) {
             ValueDict *wrong = results->at(i);
-            std::cout << "range failed: " << i << ", a: " << wrong->at("a").n << ", b: " << wrong->at("b").n
+            std::cout << "range failed: " << i << ", a: " << wrong->at("a").get_int() << ", b: " << wrong->at("b").get_int()
                       << std::endl;
             return false;
         }
@@ -280,6 +733,26 @@ bool test_btree() {
         delete vd;
     delete results;
 
+    // exclusive bounds, and bounds on just one side, through a cursor
+    int expected = 101;
+    for (BTreeCursor cursor = index.cursor(&minkey, false, &maxkey, false); ok && !cursor.at_end(); expected++) {
+        result = table.project(cursor.next());
+        ok = (*result)["a"] == Value(expected);
+        delete result;
+    }
+    ok = ok && expected == 310;
+    u_long below = 0, above = 0;
+    for (BTreeCursor cursor = index.cursor(nullptr, true, &minkey, false); !cursor.at_end(); cursor.next())
+        below++;
+    minkey["a"] = 100090;
+    for (BTreeCursor cursor = index.cursor(&minkey, false, nullptr, true); !cursor.at_end(); cursor.next())
+        above++;
+    ok = ok && index.pinned() == 0;
+    if (!ok || below != 102 || above != 9) {
+        std::cout << "cursor failed: " << expected << ", " << below << ", " << above << std::endl;
+        return false;
+    }
+
     // test range from beginning and to end
     handles = index.range(nullptr, nullptr);
     u_long count_i = handles->size();
@@ -304,3 +777,97 @@ bool test_btree() {
     table.drop();
     return true;
 }
+
+BTreeCursor::BTreeCursor(const BTreeIndex &index, BlockID leaf_id, uint at, const KeyValue *max_key,
+                         bool max_inclusive)
+        : index(index), leaf_id(leaf_id), at(at), max_key(), bounded(max_key != nullptr), max_inclusive(max_inclusive) {
+    if (max_key != nullptr)
+        this->max_key = *max_key;
+    settle();
+}
+
+// Take the handle of the next entry in the range (only if not at_end()).
+Handle BTreeCursor::next() {
+    Handle handle = leaf()->get_handle_at(this->at++);
+    settle();
+    return handle;
+}
+
+// The leaf the cursor is in.
+BTreeLeaf *BTreeCursor::leaf() const {
+    return dynamic_cast<BTreeLeaf *>(this->index.node(this->leaf_id, 1));
+}
+
+// Get onto an entry: off the end of a leaf, on to the start of the next one (passing by any that are empty).
+// If that entry is past the upper bound, or there are no more leaves, the cursor is at its end. Each leaf is
+// unpinned once looked at, so a cursor that is dropped part way holds on to nothing.
+void BTreeCursor::settle() {
+    while (this->leaf_id != 0) {
+        BTreeLeaf *leaf = this->leaf();
+        if (this->at < leaf->size()) {
+            if (this->bounded) {
+                int cmp = leaf->compare_at(this->at, &this->max_key);
+                if (cmp > 0 || (cmp == 0 && !this->max_inclusive))
+                    this->leaf_id = 0;
+            }
+            leaf->unpin();
+            return;
+        }
+        this->leaf_id = leaf->get_next_leaf();
+        this->at = 0;
+        leaf->unpin();
+    }
+}
+
+// Lookup throughput of BTreeInterior::child_index against fan-out: one interior node of INT keys per block
+// size, searched for random keys, next to a linear scan over the keys held as separate KeyValues (how
+// interior nodes used to keep them). Returns false if the two searches ever disagree.
+bool benchmark_btree() {
+    const uint LOOKUPS = 1000 * 1000;
+    std::mt19937 random(5300);
+    KeyProfile key_profile = {ColumnAttribute::INT};
+    bool ok = true;
+    std::cout << "fan-out\tbinary Mlookups/s\tlinear Mlookups/s" << std::endl;
+    for (uint block_size: {512U, 2048U, 8192U, 32768U, 131072U}) {
+        HeapFile file("__bench_btree", block_size);
+        file.create();
+        BTreeInterior *node = new BTreeInterior(file, 0, key_profile, true);
+        KeyValues boundaries;
+        node->set_first(1);
+        for (int i = 0;; i++) {
+            KeyValue boundary = {Value(2 * i)};
+            if (!node->append(&boundary, (BlockID) i + 2, block_size))
+                break;
+            boundaries.push_back(new KeyValue(boundary));
+        }
+        std::vector<KeyValue> keys;
+        std::uniform_int_distribution<int> key_value(-1, 2 * (int) boundaries.size());
+        for (uint i = 0; i < 4096; i++)
+            keys.push_back(KeyValue{Value(key_value(random))});
+
+        size_t binary_sum = 0, linear_sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint i = 0; i < LOOKUPS; i++)
+            binary_sum += node->child_index(&keys[i % keys.size()]);
+        auto middle = std::chrono::steady_clock::now();
+        for (uint i = 0; i < LOOKUPS; i++) {
+            const KeyValue &key = keys[i % keys.size()];
+            size_t j = 0;
+            while (j < boundaries.size() && !(*boundaries[j] > key))
+                j++;
+            linear_sum += j;
+        }
+        auto end = std::chrono::steady_clock::now();
+        ok = ok && binary_sum == linear_sum;
+
+        double binary_s = std::chrono::duration<double>(middle - start).count();
+        double linear_s = std::chrono::duration<double>(end - middle).count();
+        std::cout << boundaries.size() + 1 << "\t" << LOOKUPS / binary_s / 1e6 << "\t\t\t"
+                  << LOOKUPS / linear_s / 1e6 << std::endl;
+        for (auto boundary: boundaries)
+            delete boundary;
+        delete node;
+        file.drop();
+    }
+    return ok;
+}
@@ -0,0 +1,313 @@
+/**
+ * @file buffer_pool.cpp - implementation of BufferPool and PinnedPage
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#include <cstring>
+#include "buffer_pool.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param db           open Berkeley DB RecNo file whose blocks are cached
+ * @param block_size   size of the file's blocks
+ * @param frame_count  number of blocks that can be in memory at once
+ */
+BufferPool::BufferPool(Db &db, uint block_size, uint frame_count) : db(db), block_size(block_size), memory(nullptr),
+                                                                    frames(frame_count), page_table(), hand(0),
+                                                                    latch(), loaded(), requests(), requested(),
+                                                                    loader(nullptr), stopping(false) {
+    this->memory = new char[(size_t) frame_count * block_size];
+    for (auto &frame: this->frames)
+        frame = Frame{0, 0, false, false, false};
+    pools().insert(this);
+}
+
+/**
+ * Destructor. Dirty blocks are NOT written out (the owner flushes first if it wants them).
+ */
+BufferPool::~BufferPool() {
+    pools().erase(this);
+    {
+        lock_guard<mutex> lock(this->latch);
+        this->stopping = true;
+    }
+    this->requested.notify_all();
+    if (this->loader != nullptr) {
+        this->loader->join();
+        delete this->loader;
+    }
+    delete[] this->memory;
+}
+
+/**
+ * Get a block into memory and pin it there.
+ * @param block_id  which block
+ * @return          the block's bytes, valid until unpinned
+ * @throws BufferPoolError if every frame is pinned
+ */
+char *BufferPool::pin(BlockID block_id) {
+    unique_lock<mutex> lock(this->latch);
+    uint frame = lookup(lock, block_id);
+    if (frame == NO_FRAME) {
+        frame = victim();
+        if (!load(lock, frame, block_id))
+            throw BufferPoolError("block " + to_string(block_id) + " is not in the file");
+        return address(frame);
+    }
+    this->frames[frame].pin_count++;
+    this->frames[frame].referenced = true;
+    return address(frame);
+}
+
+/**
+ * Pin a frame for a block that is not in use yet. Nothing is read; the frame is zero-filled.
+ * If the block is cached anyway (read ahead as part of an extent, say), its frame is the one used.
+ * @param block_id  which block
+ * @return          the block's (zeroed) bytes, valid until unpinned
+ * @throws BufferPoolError if every frame is pinned
+ */
+char *BufferPool::pin_new(BlockID block_id) {
+    unique_lock<mutex> lock(this->latch);
+    uint frame = lookup(lock, block_id);
+    if (frame == NO_FRAME) {
+        frame = victim();
+        this->frames[frame].block_id = block_id;
+        this->page_table[block_id] = frame;
+    }
+    memset(address(frame), 0, this->block_size);
+    this->frames[frame].pin_count++;
+    this->frames[frame].referenced = true;
+    return address(frame);
+}
+
+/**
+ * Release one pin on a block (it stays cached until its frame is needed).
+ * @param block_id  which block
+ */
+void BufferPool::unpin(BlockID block_id) {
+    lock_guard<mutex> lock(this->latch);
+    auto it = this->page_table.find(block_id);
+    if (it != this->page_table.end() && this->frames[it->second].pin_count > 0)
+        this->frames[it->second].pin_count--;
+}
+
+/**
+ * Record a change to a block. If the block is cached this just marks it dirty (copying the data in
+ * first if it is not already the frame's memory); otherwise it is written straight through to the file.
+ * @param block_id  which block
+ * @param data      the block's new bytes
+ */
+void BufferPool::put(BlockID block_id, const void *data) {
+    lock_guard<mutex> lock(this->latch);
+    auto it = this->page_table.find(block_id);
+    if (it == this->page_table.end()) {
+        Dbt key(&block_id, sizeof(block_id));
+        Dbt block((void *) data, this->block_size);
+        this->db.put(nullptr, &key, &block, 0);
+        return;
+    }
+    char *bytes = address(it->second);
+    if (bytes != data)
+        memcpy(bytes, data, this->block_size);
+    this->frames[it->second].dirty = true;
+}
+
+/**
+ * Write all the dirty blocks back to the file.
+ */
+void BufferPool::flush() {
+    lock_guard<mutex> lock(this->latch);
+    for (uint frame = 0; frame < this->frames.size(); frame++)
+        if (this->frames[frame].dirty)
+            write(frame);
+}
+
+/**
+ * Start reading some blocks in the background, so that they are (more likely) cached by the time
+ * they are pinned. Blocks that are already cached are skipped; blocks that turn out not to be in
+ * the file are silently ignored.
+ * @param block_ids  the blocks, in the order they will be wanted
+ * @param count      how many
+ */
+void BufferPool::read_ahead(const BlockID *block_ids, uint count) {
+    {
+        lock_guard<mutex> lock(this->latch);
+        for (uint i = 0; i < count; i++)
+            if (this->page_table.find(block_ids[i]) == this->page_table.end())
+                this->requests.push_back(block_ids[i]);
+        if (this->loader == nullptr)
+            this->loader = new thread(&BufferPool::load_requests, this);
+    }
+    this->requested.notify_one();
+}
+
+/**
+ * Flush every buffer pool in the system.
+ */
+void BufferPool::flush_all() {
+    for (auto pool: pools())
+        pool->flush();
+}
+
+/**
+ * Find the frame a block is cached in, first waiting for it if it is still being read in.
+ * @param lock      the held latch
+ * @param block_id  the block
+ * @return          the frame number, or NO_FRAME if the block is not cached
+ */
+uint BufferPool::lookup(unique_lock<mutex> &lock, BlockID block_id) {
+    for (;;) {
+        auto it = this->page_table.find(block_id);
+        if (it == this->page_table.end())
+            return NO_FRAME;
+        if (!this->frames[it->second].loading)
+            return it->second;
+        this->loaded.wait(lock);  // look again afterwards, the read may have failed
+    }
+}
+
+/**
+ * Pick a frame to reuse with the CLOCK policy, writing back its old block if it was dirty.
+ * @return  the frame number, now empty
+ * @throws BufferPoolError if every frame is pinned
+ */
+uint BufferPool::victim() {
+    uint frame_count = (uint) this->frames.size();
+    for (uint tries = 0; tries < 2 * frame_count; tries++) {
+        uint frame = this->hand;
+        this->hand = (this->hand + 1) % frame_count;
+        Frame &candidate = this->frames[frame];
+        if (candidate.pin_count > 0 || candidate.loading)
+            continue;
+        if (candidate.referenced) {
+            candidate.referenced = false;  // second chance
+            continue;
+        }
+        if (candidate.block_id != 0) {
+            if (candidate.dirty)
+                write(frame);
+            this->page_table.erase(candidate.block_id);
+            candidate.block_id = 0;
+        }
+        return frame;
+    }
+    throw BufferPoolError("all " + to_string(frame_count) + " buffer pool frames are pinned");
+}
+
+/**
+ * Claim an empty frame for a block and read the block into it, pinned. The latch is released while
+ * reading so that other threads can use the rest of the pool; anyone wanting this block waits.
+ * @param lock      the held latch
+ * @param frame     the empty frame (from victim())
+ * @param block_id  the block
+ * @return          false if the block is not in the file (the frame is left empty and unpinned)
+ * @throws DbException if the read fails (the frame is left empty and unpinned too)
+ */
+bool BufferPool::load(unique_lock<mutex> &lock, uint frame, BlockID block_id) {
+    this->frames[frame] = Frame{block_id, 1, false, true, true};
+    this->page_table[block_id] = frame;
+    lock.unlock();
+    bool found;
+    try {
+        found = read(frame, block_id);
+    } catch (...) {
+        lock.lock();
+        unload(frame, block_id);
+        this->loaded.notify_all();
+        throw;
+    }
+    lock.lock();
+    this->frames[frame].loading = false;
+    if (!found)
+        unload(frame, block_id);
+    this->loaded.notify_all();
+    return found;
+}
+
+/**
+ * Give back the frame of a block that could not be read. Anyone waiting for it finds it gone once woken.
+ * @param frame     the frame load() claimed
+ * @param block_id  the block
+ */
+void BufferPool::unload(uint frame, BlockID block_id) {
+    this->page_table.erase(block_id);
+    this->frames[frame] = Frame{0, 0, false, false, false};
+}
+
+/**
+ * The read-ahead thread: load requested blocks into unpinned frames until the pool is destroyed.
+ */
+void BufferPool::load_requests() {
+    unique_lock<mutex> lock(this->latch);
+    for (;;) {
+        this->requested.wait(lock, [this] { return this->stopping || !this->requests.empty(); });
+        if (this->stopping)
+            return;
+        BlockID block_id = this->requests.front();
+        this->requests.pop_front();
+        if (this->page_table.find(block_id) != this->page_table.end())
+            continue;
+        uint frame;
+        try {
+            frame = victim();
+        } catch (exception &e) {
+            continue;  // no room right now, the scan will just have to read it itself
+        }
+        try {
+            if (load(lock, frame, block_id))
+                this->frames[frame].pin_count--;
+        } catch (...) {
+            continue;  // couldn't read it (the frame is free again), so the scan will just have to read it itself
+        }
+    }
+}
+
+/**
+ * Read a block in from the file, straight into a frame's memory. Called without the latch.
+ * @param frame     which frame
+ * @param block_id  which block
+ * @return          false if the block is not in the file
+ */
+bool BufferPool::read(uint frame, BlockID block_id) {
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data;
+    data.set_data(address(frame));
+    data.set_ulen(this->block_size);
+    data.set_flags(DB_DBT_USERMEM);
+    return this->db.get(nullptr, &key, &data, 0) == 0;
+}
+
+/**
+ * Write a frame's block back to the file.
+ * @param frame  which frame
+ */
+void BufferPool::write(uint frame) {
+    BlockID block_id = this->frames[frame].block_id;
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(address(frame), this->block_size);
+    this->db.put(nullptr, &key, &data, 0);
+    this->frames[frame].dirty = false;
+}
+
+// every live pool, for flush_all()
+set<BufferPool *> &BufferPool::pools() {
+    static set<BufferPool *> all;
+    return all;
+}
+
+
+/**
+ * Constructor
+ * @param pool      pool the frame belongs to (already pinned for this page)
+ * @param block     the frame's memory
+ * @param block_id  which block is in the frame
+ * @param is_new    initialize the frame as an empty page
+ */
+PinnedPage::PinnedPage(BufferPool &pool, Dbt &block, BlockID block_id, bool is_new)
+        : SlottedPage(block, block_id, is_new), pool(pool) {
+}
+
+PinnedPage::~PinnedPage() {
+    this->pool.unpin(this->block_id);
+}
@@ -0,0 +1,204 @@
+/**
+ * @file free_space_map.cpp - implementation of FreeSpaceMap
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#include <algorithm>
+#include <cstring>
+#include "free_space_map.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param name  name of the heap file being mapped
+ */
+FreeSpaceMap::FreeSpaceMap(string name) : dbfilename(name + ".fsm.db"), unit(1), block_count(0), tree(2, 0),
+                                          leaves(1), db(nullptr), pool(nullptr) {
+}
+
+FreeSpaceMap::~FreeSpaceMap() {
+    close();
+}
+
+/**
+ * Create a new, empty map (replacing any left over from an earlier file of the same name).
+ * @param block_size  size of the heap file's blocks
+ */
+void FreeSpaceMap::create(uint block_size) {
+    close();
+    Db db(_DB_ENV, 0);
+    try {
+        db.remove(this->dbfilename.c_str(), nullptr, 0);
+    } catch (DbException &e) {
+        // wasn't one
+    }
+    db_open(block_size, DB_CREATE | DB_EXCL);
+}
+
+/**
+ * Delete the map's file (if there is one).
+ */
+void FreeSpaceMap::drop() {
+    close();
+    Db db(_DB_ENV, 0);
+    try {
+        db.remove(this->dbfilename.c_str(), nullptr, 0);
+    } catch (DbException &e) {
+        // wasn't one
+    }
+}
+
+/**
+ * Open the map, creating it empty if it is not there (e.g., for a heap file from before maps were kept).
+ * @param block_size  size of the heap file's blocks
+ */
+void FreeSpaceMap::open(uint block_size) {
+    db_open(block_size, DB_CREATE);
+}
+
+/**
+ * Write the map out and close its file.
+ */
+void FreeSpaceMap::close() {
+    if (this->db == nullptr)
+        return;
+    this->pool->flush();
+    delete this->pool;
+    this->pool = nullptr;
+    this->db->close(0);
+    delete this->db;
+    this->db = nullptr;
+}
+
+/**
+ * Record how much room a block has.
+ * @param block_id    which block
+ * @param free_bytes  size of the biggest record it could take
+ */
+void FreeSpaceMap::update(BlockID block_id, uint32_t free_bytes) {
+    uint8_t category = (uint8_t) min(free_bytes / this->unit, 255U);
+    if (block_id <= this->block_count && this->tree[this->leaves + block_id - 1] == category)
+        return;
+    grow(block_id);
+    set(block_id, category);
+
+    BlockID record = block_id / PAGE_SZ + 2;
+    char *page = this->pool->pin(record);
+    page[block_id % PAGE_SZ] = (char) category;
+    this->pool->put(record, page);
+    this->pool->unpin(record);
+}
+
+/**
+ * Find the first block with room for a record.
+ * @param bytes  size of the record
+ * @return       the block id, or 0 if no block is known to have room
+ */
+BlockID FreeSpaceMap::find(uint32_t bytes) const {
+    uint32_t needed = (bytes + this->unit - 1) / this->unit;
+    if (needed > 255 || this->tree[1] < needed)
+        return 0;
+    uint node = 1;
+    while (node < this->leaves)
+        node = this->tree[2 * node] >= needed ? 2 * node : 2 * node + 1;
+    return node - this->leaves + 1;
+}
+
+/**
+ * Open the map's file and load it into the tree.
+ * @param block_size  size of the heap file's blocks
+ * @param flags       Berkeley DB open flags
+ */
+void FreeSpaceMap::db_open(uint block_size, uint flags) {
+    if (this->db != nullptr)
+        return;
+    this->unit = max(block_size / 256, 1U);
+    this->db = new Db(_DB_ENV, 0);
+    this->db->set_re_len(PAGE_SZ);
+    this->db->open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags | DB_THREAD, 0644);
+    this->pool = new BufferPool(*this->db, PAGE_SZ, 8);
+    this->block_count = 0;
+    this->tree.assign(2, 0);
+    this->leaves = 1;
+
+    BlockID header_id = 1;
+    char *header;
+    try {
+        header = this->pool->pin(header_id);
+    } catch (BufferPoolError &e) {
+        header = this->pool->pin_new(header_id);  // brand new map
+        Dbt key(&header_id, sizeof(header_id));
+        Dbt data(header, PAGE_SZ);
+        this->db->put(nullptr, &key, &data, 0);
+    }
+    BlockID block_count;
+    memcpy(&block_count, header, sizeof(block_count));
+    this->pool->unpin(header_id);
+
+    resize(block_count);
+    this->block_count = block_count;
+    for (BlockID record = 2; block_count > 0 && record <= block_count / PAGE_SZ + 2; record++) {
+        const char *page = this->pool->pin(record);
+        for (BlockID block_id = max((record - 2) * PAGE_SZ, 1U); block_id < (record - 1) * PAGE_SZ; block_id++)
+            if (block_id <= block_count)
+                set(block_id, (uint8_t) page[block_id % PAGE_SZ]);
+        this->pool->unpin(record);
+    }
+}
+
+/**
+ * Make room in the tree and the file for a block, and cover it.
+ * @param block_id  the block
+ */
+void FreeSpaceMap::grow(BlockID block_id) {
+    if (block_id <= this->block_count)
+        return;
+    resize(block_id);
+
+    // new pages of the file are written through so the RecNo file never has gaps
+    BlockID first_new = this->block_count == 0 ? 2 : this->block_count / PAGE_SZ + 3;
+    for (BlockID record = first_new; record <= block_id / PAGE_SZ + 2; record++) {
+        char *page = this->pool->pin_new(record);
+        Dbt key(&record, sizeof(record));
+        Dbt data(page, PAGE_SZ);
+        this->db->put(nullptr, &key, &data, 0);
+        this->pool->unpin(record);
+    }
+    this->block_count = block_id;
+    BlockID header_id = 1;
+    char *header = this->pool->pin(header_id);
+    memcpy(header, &this->block_count, sizeof(this->block_count));
+    this->pool->put(header_id, header);
+    this->pool->unpin(header_id);
+}
+
+/**
+ * Make the tree big enough to hold a block (without covering it yet).
+ * @param block_id  the block
+ */
+void FreeSpaceMap::resize(BlockID block_id) {
+    if (block_id > this->leaves) {
+        uint leaves = this->leaves;
+        while (leaves < block_id)
+            leaves *= 2;
+        vector<uint8_t> tree(2 * leaves, 0);
+        copy(this->tree.begin() + this->leaves, this->tree.begin() + this->leaves + this->block_count,
+             tree.begin() + leaves);
+        for (uint node = leaves - 1; node > 0; node--)
+            tree[node] = max(tree[2 * node], tree[2 * node + 1]);
+        this->tree.swap(tree);
+        this->leaves = leaves;
+    }
+}
+
+/**
+ * Set a block's category in the tree.
+ * @param block_id  the block
+ * @param category  its free space category
+ */
+void FreeSpaceMap::set(BlockID block_id, uint8_t category) {
+    uint node = this->leaves + block_id - 1;
+    this->tree[node] = category;
+    for (node /= 2; node > 0; node /= 2)
+        this->tree[node] = max(this->tree[2 * node], this->tree[2 * node + 1]);
+}
@@ -3,28 +3,46 @@
  * @author K Lundeen
  * @see Seattle University, CPSC5300
  */
+#include <algorithm>
 #include <cstring>
+#include <memory>
+#include <vector>
 #include "db_cxx.h"
 #include "heap_file.h"
 
 using namespace std;
 typedef uint16_t u16;
 
+const uint HeapFile::EXTENT_PAGES;
+const uint HeapFile::MAX_EXTENT_BYTES;
+
 /**
  * Constructor
  * @param name
+ * @param block_size   size of the blocks if the file gets created (an existing file keeps its own)
+ * @param frame_count  number of blocks the buffer pool can hold in memory while the file is open
  */
-HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {
+HeapFile::HeapFile(string name, uint block_size, uint frame_count) : DbFile(name), dbfilename(""),
+                                                                     block_size(block_size), frame_count(frame_count),
+                                                                     last(0), allocated(0), closed(true),
+                                                                     db(_DB_ENV, 0),
+                                                                     pool(nullptr), fsm(name) {
     this->dbfilename = this->name + ".db";
 }
 
+/**
+ * Destructor. Closes the file (writing back any dirty blocks) if it is still open.
+ */
+HeapFile::~HeapFile() {
+    close();
+}
+
 /**
  * Create physical file.
  */
 void HeapFile::create(void) {
     db_open(DB_CREATE | DB_EXCL);
-    SlottedPage *page = get_new(); // force one page to exist
-    delete page;
+    unique_ptr<SlottedPage> page(get_new()); // force one page to exist
 }
 
 /**
@@ -32,6 +50,7 @@ void HeapFile::create(void) {
  */
 void HeapFile::drop(void) {
     close();
+    this->fsm.drop();
     Db db(_DB_ENV, 0);
     db.remove(this->dbfilename.c_str(), nullptr, 0);
 }
@@ -44,64 +63,156 @@ void HeapFile::open(void) {
 }
 
 /**
- * Close the physical file.
+ * Close the physical file, writing back any dirty blocks first.
+ * All the pages gotten from this file must have been deleted by now.
  */
 void HeapFile::close(void) {
+    if (this->closed)
+        return;
+    this->fsm.close();
+    this->pool->flush();
+    delete this->pool;
+    this->pool = nullptr;
     this->db.close(0);
     this->closed = true;
 }
 
 /**
- * Allocate a new block for the database file.
+ * Write out the blocks changed since they were read, rather than waiting for them to be evicted or the file closed.
+ */
+void HeapFile::flush(void) {
+    if (!this->closed)
+        this->pool->flush();
+}
+
+/**
+ * Allocate a new block for the database file, from the current extent (allocating one if need be).
  * @return the new empty DbBlock that is managing the records in this block and its block id.
  */
 SlottedPage *HeapFile::get_new(void) {
-    char block[DbBlock::BLOCK_SZ];
-    memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
-
-    int block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
+    if (this->last == this->allocated)
+        allocate_extent();
+    BlockID block_id = ++this->last;
+    Dbt data(this->pool->pin_new(block_id), this->block_size);
 
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage *page = new SlottedPage(data, this->last, true);
-    this->db.put(nullptr, &key, &data, 0); // write it out with initialization done to it
-    delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
+    // the block is already on disk, empty; format the frame the same way rather than reading it
+    SlottedPage *page = new PinnedPage(*this->pool, data, block_id, true);
+    note_free_space(page);
+    return page;
 }
 
 /**
  * Get a block from the database file.
  * @param block_id
  * @return          the given slotted page (freed by caller)
+ * @throws DbRelationError if the block is not in the current page format
  */
 SlottedPage *HeapFile::get(BlockID block_id) {
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt data;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, block_id, false);
+    Dbt data(this->pool->pin(block_id), this->block_size);
+    try {
+        return new PinnedPage(*this->pool, data, block_id);
+    } catch (...) {
+        this->pool->unpin(block_id);  // not a page we can read, so nobody will unpin it
+        throw;
+    }
 }
 
 /**
- * Write a block back to the database file.
+ * Write a block back to the database file (lazily: it is marked dirty in the buffer pool).
  * @param block
  */
 void HeapFile::put(DbBlock *block) {
-    int block_id = block->get_block_id();
-    Dbt key(&block_id, sizeof(block_id));
-    this->db.put(nullptr, &key, block->get_block(), 0);
+    compact_if_fragmented(block);
+    note_free_space(block);
+    this->pool->put(block->get_block_id(), block->get_data());
+}
+
+/**
+ * Squeeze out deleted space on the way to disk, once enough of it has piled up to be worth a pass.
+ * @param block  block about to be written
+ */
+void HeapFile::compact_if_fragmented(DbBlock *block) const {
+    SlottedPage *page = dynamic_cast<SlottedPage *>(block);
+    if (page != nullptr && page->fragmented_bytes() > this->block_size / 4)
+        page->compact();
+}
+
+/**
+ * Keep the free space map up to date with a block that is being written.
+ * @param block  the block
+ */
+void HeapFile::note_free_space(DbBlock *block) {
+    SlottedPage *page = dynamic_cast<SlottedPage *>(block);
+    if (page != nullptr)
+        this->fsm.update(block->get_block_id(), page->largest_addable());
+}
+
+/**
+ * Find a block that (as far as the free space map knows) has room for a record.
+ * @param record_size  size of the record
+ * @return             the block id, or 0 if there is no such block
+ */
+BlockID HeapFile::find_room(uint32_t record_size) const {
+    return this->fsm.find(record_size);
+}
+
+/**
+ * Open (or create) the free space map, catching it up on any blocks it has not heard of yet.
+ * @param create  start a new, empty map
+ */
+void HeapFile::fsm_open(bool create) {
+    if (create)
+        this->fsm.create(this->block_size);
+    else
+        this->fsm.open(this->block_size);
+    for (BlockID block_id = this->fsm.get_block_count() + 1; block_id <= this->last; block_id++) {
+        unique_ptr<SlottedPage> page(get(block_id));
+        note_free_space(page.get());
+    }
 }
 
 /**
- * Sequence of all block ids.
- * @return block ids
+ * Cursor over a range of the file's blocks.
+ * @param start  first block id of the range
+ * @param end    last block id of the range (cut back to the current last block)
+ * @return       the cursor
  */
-BlockIDs *HeapFile::block_ids() const {
-    BlockIDs *vec = new BlockIDs();
-    for (BlockID block_id = 1; block_id <= this->last; block_id++)
-        vec->push_back(block_id);
-    return vec;
+BlockCursor HeapFile::block_cursor(BlockID start, BlockID end) const {
+    return BlockCursor(max(start, 1U), min(end, this->last));
+}
+
+/**
+ * Have the buffer pool's read-ahead thread start loading some blocks.
+ * @param block_ids  the blocks, in the order they will be gotten
+ * @param count      how many
+ */
+void HeapFile::prefetch(const BlockID *block_ids, uint count) {
+    this->pool->read_ahead(block_ids, count);
+}
+
+/**
+ * Write out a new extent of empty blocks after the last allocated one, in one bulk put.
+ * The extent is as big as the file so far, but at least one block and at most EXTENT_PAGES
+ * (and MAX_EXTENT_BYTES).
+ */
+void HeapFile::allocate_extent() {
+    uint pages = min(max(this->allocated, 1U), min(EXTENT_PAGES, max(MAX_EXTENT_BYTES / this->block_size, 1U)));
+    vector<char> empty(this->block_size, 0);
+    Dbt empty_dbt(empty.data(), this->block_size);
+    SlottedPage format(empty_dbt, 0, true);  // every new block starts out the same
+
+    u_int32_t bulk_size = (pages * (this->block_size + 64) + 3) & ~3U;  // room for Berkeley DB's bookkeeping
+    vector<char> bulk(bulk_size);
+    Dbt batch(bulk.data(), bulk_size);
+    batch.set_ulen(bulk_size);
+    batch.set_flags(DB_DBT_USERMEM);
+    DbMultipleRecnoDataBuilder builder(batch);
+    for (BlockID block_id = this->allocated + 1; block_id <= this->allocated + pages; block_id++)
+        if (!builder.append(block_id, empty.data(), this->block_size))
+            throw DbBlockNoRoomError("extent does not fit its bulk buffer");
+    Dbt unused;
+    this->db.put(nullptr, &batch, &unused, DB_MULTIPLE_KEY);
+    this->allocated += pages;
 }
 
 /**
@@ -123,9 +234,15 @@ uint32_t HeapFile::get_block_count() {
 void HeapFile::db_open(uint flags) {
     if (!this->closed)
         return;
-    this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
-    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+    this->db.set_re_len(this->block_size); // record length - will be ignored if file already exists
+    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags | DB_THREAD, 0644);  // read-ahead thread
+    u_int32_t re_len;
+    this->db.get_re_len(&re_len);  // the block size this file was created with
+    this->block_size = re_len;
 
     this->last = flags ? 0 : get_block_count();
+    this->allocated = this->last;
+    this->pool = new BufferPool(this->db, this->block_size, this->frame_count);
     this->closed = false;
+    fsm_open(flags != 0);
 }
\ No newline at end of file
@@ -3,7 +3,9 @@
  * @author K Lundeen
  * @see Seattle University, CPSC5300
  */
+#include <chrono>
 #include <cstring>
+#include <thread>
 #include "heap_storage.h"
 
 // #define DEBUG_ENABLED
@@ -69,15 +71,15 @@ static bool test_table_data() {
         return FAIL;
     }
     Value value = (*result)["a"];
-    if (12 != value.n)
+    if (12 != value.get_int())
     {
-        DEBUG_OUT_VAR("value.n != 12, was: %d\n", value.n);
+        DEBUG_OUT_VAR("value.get_int() != 12, was: %d\n", value.get_int());
         return FAIL;
     }
     value = (*result)["b"];
-    if ("Hello!" != value.s)
+    if ("Hello!" != value.get_text())
     {
-        DEBUG_OUT("value.s != 'Hello!' was TRUE\n");
+        DEBUG_OUT("value.get_text() != 'Hello!' was TRUE\n");
         return FAIL;
     }
     table.drop();
@@ -87,6 +89,491 @@ static bool test_table_data() {
     return PASS;
 }
 
+// Tests inserting a batch of rows, including a batch that is rejected as a whole
+static bool test_table_insert_batch() {
+    DEBUG_OUT("===== Testing HeapTable : Insert Batch =====\n");
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    HeapTable table("_test_insert_batch_cpp", c_names, c_attrs);
+    table.create();
+    ValueDicts rows;
+    for (int i = 0; i < 1000; i++) {
+        ValueDict *row = new ValueDict();
+        (*row)["a"] = Value(i);
+        (*row)["b"] = Value("batch " + to_string(i));
+        rows.push_back(row);
+    }
+    Handles *handles = table.insert_batch(&rows);
+    bool ok = handles->size() == rows.size();
+    for (size_t i = 0; ok && i < handles->size(); i += 97) {
+        ValueDict *result = table.project((*handles)[i]);
+        ok = *result == *rows[i];
+        delete result;
+    }
+    delete handles;
+
+    rows.back()->erase("b");  // one bad row spoils the batch
+    bool rejected = false;
+    try {
+        delete table.insert_batch(&rows);
+    } catch (DbRelationError &e) {
+        rejected = true;
+    }
+    handles = table.select();
+    ok = ok && rejected && handles->size() == 1000;
+    delete handles;
+    for (auto row: rows)
+        delete row;
+    table.drop();
+    return ok ? PASS : FAIL;
+}
+
+// Tests the compact Value: inline short TEXT, owned long TEXT, copies, moves and comparisons
+static bool test_value() {
+    DEBUG_OUT("===== Testing Value =====\n");
+    string long_text(100, 'L');
+    Value small("fourteen chars"), big(long_text), n(-7), b;
+    b.set_boolean(true);
+    if (sizeof(Value) != 16 || small.text_size() != Value::SMALL_TEXT || big.get_text() != long_text ||
+        n.get_int() != -7 || b.get_data_type() != ColumnAttribute::BOOLEAN || !b.get_boolean())
+        return assertion_failure("value construction");
+
+    Value copy(big), moved(std::move(copy));
+    if (moved != big || copy.get_data_type() != ColumnAttribute::INT || moved.text_data() == big.text_data())
+        return assertion_failure("value copy/move");
+    copy = small;
+    moved = n;
+    big = big;
+    Value part(long_text + "tail");
+    part.set_text(part.text_data() + 100, 4);  // some of its own characters
+    if (copy != small || moved != n || big.get_text() != long_text || part.get_text() != "tail")
+        return assertion_failure("value assignment");
+    part.set_text(long_text.data(), 50);
+    part = Value(long_text);
+    if (part != big)
+        return assertion_failure("value reassignment");
+
+    ValueDict row;
+    row["x"] = Value("abc");
+    if (!(Value("abc") < Value("abd")) || !(Value("ab") < Value("abc")) || Value("abc") < Value("ab") ||
+        !(b < n) || !(n < small) || !(Value(-8) < n) || row["x"] != Value(string("abc")))
+        return assertion_failure("value comparison");
+    return PASS;
+}
+
+// Tests the statement arena, and projecting rows into one
+static bool test_arena() {
+    DEBUG_OUT("===== Testing Arena =====\n");
+    char *first;
+    {
+        Arena arena;
+        first = static_cast<char *>(arena.allocate(3, 1));
+        int64_t *n = static_cast<int64_t *>(arena.allocate(sizeof(int64_t), alignof(int64_t)));
+        char *big = static_cast<char *>(arena.allocate(Arena::CHUNK_SZ));  // gets its own block
+        memset(big, 'x', Arena::CHUNK_SZ);
+        Value *values = arena.make_array<Value>(100);
+        bool ok = (uintptr_t) n % alignof(int64_t) == 0 && (char *) n < first + 16 &&
+                  (uintptr_t) values % alignof(Value) == 0 && values[99] == Value(0) &&
+                  arena.get_size() == 3 + sizeof(int64_t) + Arena::CHUNK_SZ + 100 * sizeof(Value) &&
+                  string(arena.copy("hello", 5), 5) == "hello";
+        if (!ok)
+            return assertion_failure("arena allocate");
+    }
+    {
+        Arena arena;
+        if (arena.allocate(1, 1) != first)
+            return assertion_failure("arena chunk not recycled");
+    }
+
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    HeapTable table("_test_arena_cpp", c_names, c_attrs);
+    table.create();
+    ValueDict row;
+    row["b"] = Value(string(100, 'b'));
+    for (int i = 0; i < 100; i++) {
+        row["a"] = Value(i);
+        table.insert(&row);
+    }
+    Handles *handles = table.select();
+    Arena *arena = new Arena();
+    RowSet *rows = table.project_rows(handles, nullptr, arena);
+    bool ok = rows->size() == 100 && rows->get_arena() == arena && (*rows)[99][0] == Value(99) &&
+              (*rows)[99][1] == row["b"] && arena->get_size() >= 100 * (2 * sizeof(Value) + 100);
+    Value copy((*rows)[0][1]);
+    delete rows;
+    delete arena;
+    ok = ok && copy == row["b"];  // a copy has its own characters
+    delete handles;
+    table.drop();
+    return ok ? PASS : FAIL;
+}
+
+// Tests the RowCodec layout: fixed columns at constant offsets, any column read without the rest
+static bool test_row_codec() {
+    DEBUG_OUT("===== Testing RowCodec =====\n");
+    ColumnNames c_names = {"t1", "i1", "flag", "t2", "i2"};
+    ColumnAttributes c_attrs = {ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::INT),
+                                ColumnAttribute(ColumnAttribute::BOOLEAN), ColumnAttribute(ColumnAttribute::TEXT),
+                                ColumnAttribute(ColumnAttribute::INT)};
+    ValueDict row;
+    row["t1"] = Value("hello");
+    row["i1"] = Value(-12);
+    row["flag"].set_boolean(true);
+    row["t2"] = Value("");
+    row["i2"] = Value(1234567);
+    row["extra"] = Value(99);  // not a column, ignored
+    for (uint block_size : {DbBlock::BLOCK_SZ, 256U * 1024}) {
+        RowCodec codec(c_names, c_attrs, block_size);
+        uint32_t offset_size = block_size > SlottedPage::MAX_NARROW_SZ ? 4 : 2;
+        uint32_t size = codec.size(&row);
+        if (size != 4 + 4 + 1 + 2 * offset_size + 5)
+            return assertion_failure("codec size", size);
+        char *bytes = new char[size];
+        codec.marshal(&row, bytes);
+        bool ok = *(int32_t *) bytes == -12 && *(int32_t *) (bytes + 4) == 1234567 && bytes[8] == 1;
+        for (uint col_num = 0; ok && col_num < c_names.size(); col_num++) {
+            Value value;
+            codec.get(bytes, col_num, value);
+            ok = value == row[c_names[col_num]] && codec.equals(bytes, col_num, value);
+        }
+        ok = ok && !codec.equals(bytes, 0, Value("hellO")) && !codec.equals(bytes, 4, Value(0));
+        delete[] bytes;
+        if (!ok)
+            return assertion_failure("codec get/equals", block_size);
+    }
+
+    RowCodec codec(c_names, c_attrs, DbBlock::BLOCK_SZ);
+    row["t2"] = Value(string(DbBlock::BLOCK_SZ, 'x'));
+    bool too_big = false;
+    try {
+        codec.size(&row);
+    } catch (DbRelationError &e) {
+        too_big = true;
+    }
+    row.erase("i2");
+    bool missing = false;
+    try {
+        codec.size(&row);
+    } catch (DbRelationError &e) {
+        missing = true;
+    }
+    if (!too_big || !missing)
+        return FAIL;
+
+    // a file not stamped with the current layout is refused rather than misread
+    row["i2"] = Value(1234567);
+    row["t2"] = Value("");
+    HeapFile file("_test_row_format_cpp");
+    file.create();
+    file.close();
+    HeapTable old_table("_test_row_format_cpp", c_names, c_attrs);
+    bool refused = false;
+    try {
+        old_table.open();
+    } catch (DbRelationError &e) {
+        refused = true;
+    }
+    old_table.drop();
+    if (!refused)
+        return assertion_failure("unstamped file opened");
+
+    // and the biggest row the codec allows fits in an empty block
+    HeapTable table("_test_row_format_cpp", c_names, c_attrs);
+    table.create();
+    row["t2"] = Value(string(SlottedPage::max_record_size(DbBlock::BLOCK_SZ) - codec.size(&row), 'x'));
+    Handle handle = table.insert(&row);
+    ValueDict *result = table.project(handle);
+    bool ok = (*result)["t2"] == row["t2"];
+    delete result;
+    table.drop();
+    return ok ? PASS : assertion_failure("biggest row");
+}
+
+// Tests projecting many rows at once into positional rows
+static bool test_project_rows() {
+    DEBUG_OUT("===== Testing HeapTable : Project Rows =====\n");
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    HeapTable table("_test_project_rows_cpp", c_names, c_attrs);
+    table.create();
+    ValueDict row;
+    for (int i = 0; i < 500; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value("row " + to_string(i));
+        table.insert(&row);
+    }
+    Handles *handles = table.select();
+    ColumnNames projection = {"b", "a"};
+    RowSet *rows = table.project_rows(handles, &projection);
+    bool ok = rows->size() == handles->size() && rows->get_schema().get_column_names() == projection &&
+              rows->get_schema().get_column_attributes()[0].get_data_type() == ColumnAttribute::TEXT;
+    for (size_t i = 0; ok && i < rows->size(); i++) {
+        const Row &r = (*rows)[i];
+        ValueDict *expected = table.project((*handles)[i]);
+        ValueDict *dict = r.to_dict();
+        ok = r[0] == expected->at("b") && r[1] == expected->at("a") && r.at("a") == expected->at("a") &&
+             dict->size() == 2 && (*dict)["b"] == expected->at("b");
+        delete dict;
+        delete expected;
+    }
+    delete rows;
+
+    rows = table.project_rows(handles);
+    ok = ok && rows->get_schema().get_column_names() == c_names && (*rows)[499][0] == Value(499);
+    delete rows;
+
+    // out of block order: still one row per handle, in the handles' order
+    Handles shuffled(handles->rbegin(), handles->rend());
+    for (size_t i = 0; i + 7 < shuffled.size(); i += 7)
+        swap(shuffled[i], shuffled[i + 3]);
+    projection = {"a"};
+    rows = table.project_rows(&shuffled, &projection);
+    ValueDicts *dicts = table.project(&shuffled);
+    ok = ok && rows->size() == shuffled.size() && dicts->size() == shuffled.size();
+    for (size_t i = 0; ok && i < shuffled.size(); i++) {
+        ValueDict *expected = table.project(shuffled[i]);
+        ok = (*rows)[i][0] == expected->at("a") && *(*dicts)[i] == *expected;
+        delete expected;
+    }
+    for (auto dict: *dicts)
+        delete dict;
+    delete dicts;
+    delete rows;
+
+    projection.push_back("c");
+    bool rejected = false;
+    try {
+        delete table.project_rows(handles, &projection);
+    } catch (DbRelationError &e) {
+        rejected = true;
+    }
+
+    // a handle to a deleted row is refused, not decoded
+    table.del((*handles)[250]);
+    bool gone = false;
+    try {
+        delete table.project_rows(handles);
+    } catch (DbRelationError &e) {
+        gone = true;
+    }
+    delete handles;
+    table.drop();
+    return ok && rejected && gone ? PASS : FAIL;
+}
+
+// Tests HeapTables whose files use bigger blocks, including ones past the narrow SlottedPage limit
+static bool test_table_block_sizes() {
+    DEBUG_OUT("===== Testing HeapTable : Block Sizes =====\n");
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    uint block_sizes[] = {32 * 1024, 256 * 1024};
+    for (uint block_size : block_sizes) {
+        HeapTable table("_test_block_size_cpp", c_names, c_attrs, block_size);
+        table.create();
+        ValueDict row;
+        row["b"] = Value(string(1000, 'b'));
+        for (int i = 0; i < 1000; i++) {
+            row["a"] = Value(i);
+            table.insert(&row);
+        }
+        Handles *handles = table.select();
+        uint max_blocks = 1000 / ((block_size - 16) / 1014) + 1;  // 1006-byte rows plus header room
+        bool ok = handles->size() == 1000 && handles->back().first <= max_blocks;
+        ValueDict *result = ok ? table.project(handles->back()) : nullptr;
+        ok = ok && (*result)["a"].get_int() == 999 && (*result)["b"].get_text() == row["b"].get_text();
+        delete result;
+        delete handles;
+        table.drop();
+        if (!ok) {
+            DEBUG_OUT_VAR("%u byte blocks failed\n", block_size);
+            return FAIL;
+        }
+        DEBUG_OUT_VAR("%u byte blocks ok\n", block_size);
+    }
+    return PASS;
+}
+
+// Test a HeapTable kept in a memory-mapped file, including growing it and reopening it
+static bool test_mmap_table() {
+    DEBUG_OUT("===== Testing HeapTable : MMap Backend =====\n");
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    HeapTable table("_test_mmap_cpp", c_names, c_attrs, DbBlock::BLOCK_SZ, HeapTable::MMAP);
+    table.create();
+    ValueDict row;
+    row["b"] = Value(string(100, 'm'));
+    for (int i = 0; i < 5000; i++) {  // well past the initial mapping
+        row["a"] = Value(i);
+        table.insert(&row);
+    }
+    table.close();
+    table.open();
+    Handles *handles = table.select();
+    bool ok = handles->size() == 5000;
+    ValueDict *result = ok ? table.project(handles->back()) : nullptr;
+    ok = ok && (*result)["a"].get_int() == 4999 && (*result)["b"].get_text() == row["b"].get_text();
+    delete result;
+
+    // creating it again fails without touching the existing file
+    table.close();
+    bool refused = false;
+    try {
+        table.create();
+    } catch (DbException &e) {
+        refused = true;
+    }
+    table.open();
+    Handles *again = table.select();
+    ok = ok && refused && again->size() == 5000;
+    delete again;
+
+    if (ok) {
+        table.del(handles->front());
+        ValueDict where;
+        where["a"] = Value(0);
+        Handles *gone = table.select(&where);
+        ok = gone->empty();
+        delete gone;
+    }
+
+    // a handle outside the file is refused, not followed into unmapped memory
+    for (BlockID block_id: {0U, 1000U * 1000}) {
+        bool outside = false;
+        try {
+            delete table.project(Handle(block_id, 1));
+        } catch (DbRelationError &e) {
+            outside = true;
+        }
+        ok = ok && outside;
+    }
+    delete handles;
+    table.drop();
+    if (!ok) {
+        DEBUG_OUT("mmap table failed\n");
+        return FAIL;
+    }
+    return PASS;
+}
+
+// Test that inserts go back into space freed by deletes, before and after reopening the table
+static bool test_free_space_reuse() {
+    DEBUG_OUT("===== Testing HeapTable : Free Space Reuse =====\n");
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    HeapTable table("_test_fsm_cpp", c_names, c_attrs);
+    table.create();
+    ValueDict row;
+    row["b"] = Value(string(200, 'f'));
+    for (int i = 0; i < 1000; i++) {
+        row["a"] = Value(i);
+        table.insert(&row);
+    }
+    Handles *handles = table.select();
+    BlockID last = handles->back().first;
+    for (size_t i = 0; i < handles->size() / 2; i++)
+        table.del((*handles)[i]);
+    delete handles;
+
+    bool ok = true;
+    for (int round = 0; round < 2 && ok; round++) {
+        if (round == 1) {  // the map has to come back from its file
+            table.close();
+            table.open();
+            handles = table.select();
+            for (size_t i = 0; i < 250; i++)
+                table.del((*handles)[i]);
+            delete handles;
+        }
+        for (int i = 0; i < (round == 0 ? 500 : 250); i++) {
+            row["a"] = Value(1000 + i);
+            Handle handle = table.insert(&row);
+            if (handle.first > last) {
+                DEBUG_OUT_VAR("round %d: insert went to a new block\n", round);
+                ok = false;
+                break;
+            }
+        }
+    }
+    handles = table.select();
+    ok = ok && handles->size() == 1000;
+    delete handles;
+    table.drop();
+    return ok ? PASS : FAIL;
+}
+
+// Count the rows another HeapTable object on the same file can see (so only what has been written back)
+static size_t count_written_rows(const ColumnNames &c_names, const ColumnAttributes &c_attrs) {
+    HeapTable reader("_test_tail_cpp", c_names, c_attrs);
+    Handles *handles = reader.select();
+    size_t count = handles->size();
+    delete handles;
+    return count;
+}
+
+// Test the resident tail page: rows show up right away, and reach the file when flushed
+static bool test_tail_page() {
+    DEBUG_OUT("===== Testing HeapTable : Tail Page =====\n");
+    ColumnNames c_names;
+    ColumnAttributes c_attrs;
+    initialize_columns(c_names, c_attrs);
+    HeapTable table("_test_tail_cpp", c_names, c_attrs);
+    table.create();
+    table.set_tail_flush(1000, 60 * 1000);
+    ValueDict row;
+    row["b"] = Value("tail");
+    Handle handle;
+    for (int i = 0; i < 10; i++) {
+        row["a"] = Value(i);
+        handle = table.insert(&row);
+    }
+    Handles *handles = table.select();
+    bool ok = handles->size() == 10;
+    delete handles;
+    BufferPool::flush_all();
+    ok = ok && count_written_rows(c_names, c_attrs) == 0;  // still only in the tail page
+    HeapTable::flush_all();
+    BufferPool::flush_all();
+    ok = ok && count_written_rows(c_names, c_attrs) == 10;
+    if (!ok) {
+        DEBUG_OUT("tail page rows not visible or not flushed\n");
+        return FAIL;
+    }
+
+    table.del(handle);  // in the tail page, through a second page on the same frame
+    row["a"] = Value(99);
+    if (table.insert(&row) != handle) {
+        DEBUG_OUT("tail page did not see the delete\n");
+        return FAIL;
+    }
+    table.set_tail_flush(7, 60 * 1000);
+    row["b"] = Value(string(100, 't'));
+    for (int i = 0; i < 500; i++) {  // fills a few pages
+        row["a"] = Value(100 + i);
+        table.insert(&row);
+    }
+    table.close();
+    table.open();
+    handles = table.select();
+    ok = handles->size() == 510;
+    ValueDict *result = ok ? table.project(handles->back()) : nullptr;
+    ok = ok && (*result)["a"].get_int() == 599;
+    delete result;
+    delete handles;
+    table.drop();
+    if (!ok) {
+        DEBUG_OUT("tail page lost rows\n");
+        return FAIL;
+    }
+    return PASS;
+}
+
 // Tests HeapFile functionality
 static bool test_file() {
     DEBUG_OUT("===== Testing HeapFile =====\n");
@@ -143,6 +630,230 @@ static bool test_file() {
     return PASS;
 }
 
+// Test extent allocation: consecutive new blocks, and the unused part of an extent after reopening
+static bool test_extents() {
+    DEBUG_OUT("===== Testing HeapFile extents =====\n");
+    const uint blocks = 100;
+    HeapFile hf("_extent_test");
+    hf.create();
+    for (BlockID expected = 2; expected <= blocks; expected++) {
+        SlottedPage *page = hf.get_new();
+        bool ok = page->get_block_id() == expected && page->size() == 0 && hf.get_last_block_id() == expected;
+        delete page;
+        if (!ok) {
+            DEBUG_OUT_VAR("new block %u wrong\n", expected);
+            return FAIL;
+        }
+    }
+    hf.close();
+    hf.open();
+    BlockID last = hf.get_last_block_id();
+    bool ok = last >= blocks && last < 2 * blocks;
+    for (BlockID block_id = blocks; ok && block_id <= last; block_id++) {
+        SlottedPage *page = hf.get(block_id);
+        ok = page->size() == 0 && page->largest_addable() > 0;
+        delete page;
+    }
+    SlottedPage *page = hf.get_new();
+    ok = ok && page->get_block_id() == last + 1;
+    delete page;
+    hf.drop();
+    if (!ok) {
+        DEBUG_OUT("extent blocks wrong after reopening\n");
+        return FAIL;
+    }
+    return PASS;
+}
+
+// Test HeapFile's buffer pool: eviction, write back, and running out of frames
+static bool test_buffer_pool() {
+    DEBUG_OUT("===== Testing BufferPool =====\n");
+    const uint frames = 4, blocks = 10;
+    char data[] = "buffer pool record";
+    Dbt record(data, sizeof(data));
+
+    HeapFile hf("_buffer_pool_test", DbBlock::BLOCK_SZ, frames);
+    hf.create();
+    for (BlockID block_id = 2; block_id <= blocks; block_id++) {
+        SlottedPage *page = hf.get_new();
+        delete page;
+    }
+    for (BlockID block_id = 1; block_id <= blocks; block_id++) {
+        SlottedPage *page = hf.get(block_id);
+        for (BlockID i = 0; i < block_id; i++)
+            page->add(&record);
+        hf.put(page);  // only dirty in the pool, must survive being evicted
+        delete page;
+    }
+    for (BlockID block_id = 1; block_id <= blocks; block_id++) {
+        SlottedPage *page = hf.get(block_id);
+        uint count = 0;
+        for (RecordID id: page->live_ids()) {
+            if (page->view(id).size != sizeof(data) || memcmp(page->view(id).data, data, sizeof(data)) != 0) {
+                DEBUG_OUT("record lost on eviction...\n");
+                return FAIL;
+            }
+            count++;
+        }
+        delete page;
+        if (count != block_id) {
+            DEBUG_OUT("wrong number of records after eviction...\n");
+            return FAIL;
+        }
+    }
+    DEBUG_OUT("eviction ok\n");
+
+    std::vector<SlottedPage *> pinned;
+    for (BlockID block_id = 1; block_id <= frames; block_id++)
+        pinned.push_back(hf.get(block_id));
+    bool ran_out = false;
+    try {
+        delete hf.get(frames + 1);
+    } catch (BufferPoolError &e) {
+        ran_out = true;
+    }
+    for (auto page: pinned)
+        delete page;
+    if (!ran_out) {
+        DEBUG_OUT("got a block with every frame pinned...\n");
+        return FAIL;
+    }
+    delete hf.get(frames + 1);  // fine again once something is unpinned
+    DEBUG_OUT("pinning ok\n");
+
+    // a block of the extent that is already cached when get_new() hands it out keeps its one frame
+    BlockID next = hf.get_last_block_id() + 1;
+    delete hf.get(next);
+    SlottedPage *fresh = hf.get_new();
+    fresh->add(&record);
+    hf.put(fresh);
+    delete fresh;
+    for (BlockID block_id = 1; block_id <= 2 * frames; block_id++) {  // through some evictions
+        delete hf.get(block_id);
+        fresh = hf.get(next);
+        uint fresh_count = fresh->size();
+        delete fresh;
+        if (fresh_count != 1) {
+            DEBUG_OUT("new block lost its record...\n");
+            return FAIL;
+        }
+    }
+
+    hf.close();
+    hf.open();
+    SlottedPage *page = hf.get(blocks);
+    uint count = page->size();
+    delete page;
+    if (count != blocks) {
+        DEBUG_OUT("dirty blocks not written back on close...\n");
+        return FAIL;
+    }
+    DEBUG_OUT("close ok\n");
+    hf.drop();
+
+    // a block the read-ahead thread can't read (bigger than the pool's blocks) is left for pin() to fail on
+    const char *bad_name = "_buffer_pool_bad_test.db";
+    Db bad(_DB_ENV, 0);
+    bad.set_re_len(2 * DbBlock::BLOCK_SZ);
+    bad.open(nullptr, bad_name, nullptr, DB_RECNO, DB_CREATE | DB_EXCL | DB_THREAD, 0644);
+    std::vector<char> big(2 * DbBlock::BLOCK_SZ, 'x');
+    BlockID bad_id = 1;
+    Dbt bad_key(&bad_id, sizeof(bad_id)), big_data(big.data(), (u_int32_t) big.size());
+    bad.put(nullptr, &bad_key, &big_data, 0);
+    bool read_failed = false;
+    {
+        BufferPool pool(bad, DbBlock::BLOCK_SZ, frames);
+        pool.read_ahead(&bad_id, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));  // let the read-ahead thread get to it first
+        try {
+            pool.pin(bad_id);
+        } catch (DbException &e) {
+            read_failed = true;
+        }
+    }
+    bad.close(0);
+    Db(_DB_ENV, 0).remove(bad_name, nullptr, 0);
+    if (!read_failed) {
+        DEBUG_OUT("read a block too big for the pool...\n");
+        return FAIL;
+    }
+    DEBUG_OUT("read errors ok\n");
+    return PASS;
+}
+
+// A HeapFile that keeps count of the scans it is told about
+class ScanCountingFile : public HeapFile {
+public:
+    ScanCountingFile(std::string name, uint block_size, uint frame_count) : HeapFile(name, block_size, frame_count),
+                                                                         begun(0), running(0) {}
+
+    virtual void begin_scan(const BlockCursor &cursor) {
+        begun++;
+        running++;
+    }
+
+    virtual void end_scan(const BlockCursor &cursor) { running--; }
+
+    int begun, running;
+};
+
+// Test block cursors (ranges, resuming) and a cold sequential scan through ReadAhead
+static bool test_read_ahead() {
+    DEBUG_OUT("===== Testing BlockCursor and ReadAhead =====\n");
+    const uint blocks = 300;
+    ScanCountingFile hf("_read_ahead_test", DbBlock::BLOCK_SZ, 32);
+    hf.create();
+    for (BlockID block_id = 1; block_id <= blocks; block_id++) {
+        SlottedPage *page = block_id == 1 ? hf.get(1) : hf.get_new();
+        Dbt record(&block_id, sizeof(block_id));
+        page->add(&record);
+        hf.put(page);
+        delete page;
+    }
+
+    BlockCursor range = hf.block_cursor(100, 120);
+    uint count = 0;
+    while (!range.at_end())
+        if (range.next() != 100 + count++)
+            return FAIL;
+    BlockCursor clipped = hf.block_cursor(290, 1000);
+    if (count != 21 || clipped.get_end() != blocks || !hf.block_cursor(5, 4).at_end()) {
+        DEBUG_OUT("block cursor ranges wrong\n");
+        return FAIL;
+    }
+    DEBUG_OUT("block cursor ok\n");
+
+    hf.close();
+    hf.open();  // nothing cached; the rest of the last extent now shows up as empty blocks
+    BlockID expected = 1;
+    BlockCursor resume_at = hf.block_cursor();
+    for (int part = 0; part < 2; part++) {
+        ReadAhead scan(hf, resume_at);
+        while (SlottedPage *page = static_cast<SlottedPage *>(scan.next())) {
+            RecordView record = page->view(1);
+            bool ok = page->get_block_id() == expected && (expected > blocks ? page->size() == 0 :
+                      record.size == sizeof(BlockID) && memcmp(record.data, &expected, sizeof(BlockID)) == 0);
+            delete page;
+            if (!ok || scan.get_window() < ReadAhead::MIN_WINDOW || scan.get_window() > ReadAhead::MAX_WINDOW) {
+                DEBUG_OUT_VAR("read ahead scan went wrong at block %u\n", expected);
+                return FAIL;
+            }
+            expected++;
+            if (part == 0 && expected == blocks / 2)
+                break;  // stop half way, then pick up where we left off
+        }
+        resume_at = hf.block_cursor(scan.get_cursor().get_position());
+    }
+    bool all = expected == hf.get_last_block_id() + 1 && expected > blocks;
+    all = all && hf.begun == 2 && hf.running == 0;  // the scan given up half way was ended too
+    hf.drop();
+    if (!all) {
+        DEBUG_OUT("read ahead scan missed blocks\n");
+        return FAIL;
+    }
+    return PASS;
+}
+
 // Test SlottedPage functionality
 static bool test_slotted_page_burgi() {
     DEBUG_OUT("===== Testing SlottedPage =====\n");
@@ -181,11 +892,139 @@ static bool test_slotted_page_burgi() {
         return FAIL;
     }
     delete retrieved;
+
+    RecordView view = page.view(rec_id);
+    if (view.size != strlen(big_data) + 1 || strcmp(view.data, big_data) != 0) {
+        DEBUG_OUT_VAR("view did not match record (id: %u)\n", rec_id);
+        return FAIL;
+    }
+    DEBUG_OUT("view ok\n");
     page.del(rec_id);
+    if (!page.view(rec_id).is_deleted()) {
+        DEBUG_OUT("view of deleted record was not empty...\n");
+        return FAIL;
+    }
+
+    // a block written in the older layout (record count first) is refused
+    memset(block, 0, sizeof(block));
+    *(u16 *) block = 1;
+    try {
+        SlottedPage old(dbt, 1);
+        DEBUG_OUT("old page format was not refused...\n");
+        return FAIL;
+    } catch (DbRelationError &e) {
+        DEBUG_OUT("page format ok\n");
+    }
 
     return PASS;
 }
 
+// Tests that deletes are deferred and their space is reclaimed by compaction when it is needed
+static bool test_slotted_page_compaction() {
+    DEBUG_OUT("===== Testing SlottedPage compaction =====\n");
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt dbt(block, sizeof(block));
+    SlottedPage page(dbt, 1, true);
+
+    char rec[100];
+    memset(rec, 'x', sizeof(rec));
+    Dbt rec_dbt(rec, sizeof(rec));
+    RecordIDs ids;
+    try {
+        while (true) {
+            rec[0] = (char) ('a' + ids.size() % 26);
+            ids.push_back(page.add(&rec_dbt));
+        }
+    } catch (DbBlockNoRoomError &e) {
+        // page is full
+    }
+
+    // delete every other record -- nothing moves, the bytes are just marked as reclaimable
+    uint deleted = 0;
+    for (uint i = 0; i < ids.size(); i += 2, deleted++)
+        page.del(ids[i]);
+    if (page.fragmented_bytes() != deleted * sizeof(rec)) {
+        DEBUG_OUT_VAR("fragmented bytes were %u\n", page.fragmented_bytes());
+        return FAIL;
+    }
+
+    // growing a record only fits after compaction
+    char big[300];
+    memset(big, 'y', sizeof(big));
+    Dbt big_dbt(big, sizeof(big));
+    page.put(ids[1], big_dbt);
+    RecordView view = page.view(ids[1]);
+    if (view.size != sizeof(big) || memcmp(view.data, big, sizeof(big)) != 0) {
+        DEBUG_OUT("enlarged record did not survive compaction\n");
+        return FAIL;
+    }
+
+    // and so do new records
+    uint added = 0;
+    try {
+        while (true) {
+            page.add(&rec_dbt);
+            added++;
+        }
+    } catch (DbBlockNoRoomError &e) {
+        // page is full again
+    }
+    if (added < deleted - 4) {
+        DEBUG_OUT_VAR("only %u records fit after compaction\n", added);
+        return FAIL;
+    }
+    for (uint i = 3; i < ids.size(); i += 2) {
+        view = page.view(ids[i]);
+        if (view.size != sizeof(rec) || view.data[0] != (char) ('a' + i % 26) || view.data[1] != 'x') {
+            DEBUG_OUT_VAR("record %u moved incorrectly\n", ids[i]);
+            return FAIL;
+        }
+    }
+    return PASS;
+}
+
+// Tests that the ids of deleted records get reused while the other records keep theirs
+static bool test_slotted_page_slot_reuse() {
+    DEBUG_OUT("===== Testing SlottedPage slot reuse =====\n");
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt dbt(block, sizeof(block));
+    SlottedPage page(dbt, 1, true);
+
+    char rec[] = "churn";
+    Dbt rec_dbt(rec, sizeof(rec));
+    for (int i = 0; i < 10; i++)
+        page.add(&rec_dbt);
+    page.del(3);
+    page.del(7);
+    uint32_t fragmented = page.fragmented_bytes();
+    page.del(7);  // again: must not link the slot to itself or count its bytes twice
+    page.del(12);  // never added
+    if (page.fragmented_bytes() != fragmented) {
+        DEBUG_OUT("deleting a deleted record changed the page\n");
+        return FAIL;
+    }
+    RecordID first = page.add(&rec_dbt);
+    RecordID second = page.add(&rec_dbt);
+    if (!((first == 7 && second == 3) || (first == 3 && second == 7))) {
+        DEBUG_OUT_VAR("deleted ids were not reused (got %u and %u)\n", first, second);
+        return FAIL;
+    }
+    if (page.size() != 10 || page.add(&rec_dbt) != 11) {
+        DEBUG_OUT("slot directory grew while there were free slots\n");
+        return FAIL;
+    }
+    for (RecordID record_id: page.live_ids()) {
+        RecordView view = page.view(record_id);
+        if (view.size != sizeof(rec) || memcmp(view.data, rec, sizeof(rec)) != 0) {
+            DEBUG_OUT_VAR("record %u damaged by slot reuse\n", record_id);
+            return FAIL;
+        }
+    }
+    return PASS;
+}
+
 /**
  * Print out given failure message and return false.
  * @param message reason for failure
@@ -467,18 +1306,18 @@ void test_set_row(ValueDict &row, int a, string b) {
 bool test_compare(DbRelation &table, Handle handle, int a, string b) {
     ValueDict *result = table.project(handle);
     Value value = (*result)["a"];
-    if (value.n != a) {
+    if (value.get_int() != a) {
         delete result;
         return false;
     }
     value = (*result)["b"];
-    if (value.s != b) {
+    if (value.get_text() != b) {
 		delete result;
         return false;
 	}
     value = (*result)["c"];
     delete result;
-    if (value.n != (a % 2 == 0))
+    if (value.get_int() != (a % 2 == 0))
         return false;
     return true;
 
@@ -498,15 +1337,60 @@ bool test_heap_storage() {
     if (!test_table_data())
         return assertion_failure("table data tests failed");
     cout << "table data tests ok" << endl;
+    if (!test_table_insert_batch())
+        return assertion_failure("table insert batch tests failed");
+    cout << "table insert batch tests ok" << endl;
+    if (!test_value())
+        return assertion_failure("value tests failed");
+    cout << "value tests ok" << endl;
+    if (!test_arena())
+        return assertion_failure("arena tests failed");
+    cout << "arena tests ok" << endl;
+    if (!test_row_codec())
+        return assertion_failure("row codec tests failed");
+    cout << "row codec tests ok" << endl;
+    if (!test_project_rows())
+        return assertion_failure("project rows tests failed");
+    cout << "project rows tests ok" << endl;
+
+    if (!test_table_block_sizes())
+        return assertion_failure("table block size tests failed");
+    cout << "table block size tests ok" << endl;
+    if (!test_mmap_table())
+        return assertion_failure("mmap table tests failed");
+    cout << "mmap table tests ok" << endl;
+    if (!test_free_space_reuse())
+        return assertion_failure("free space reuse tests failed");
+    cout << "free space reuse tests ok" << endl;
+    if (!test_tail_page())
+        return assertion_failure("tail page tests failed");
+    cout << "tail page tests ok" << endl;
 
     if (!test_file())
         return assertion_failure("file tests failed");
     cout << "file tests ok" << endl;
+    if (!test_extents())
+        return assertion_failure("extent tests failed");
+    cout << "extent tests ok" << endl;
+    if (!test_buffer_pool())
+        return assertion_failure("buffer pool tests failed");
+    cout << "buffer pool tests ok" << endl;
+    if (!test_read_ahead())
+        return assertion_failure("block cursor/read ahead tests failed");
+    cout << "block cursor/read ahead tests ok" << endl;
     
     if (!test_slotted_page_burgi())
         return assertion_failure("slotted page Burgi tests failed");
     cout << "slotted page Burgi tests ok" << endl;
 
+    if (!test_slotted_page_compaction())
+        return assertion_failure("slotted page compaction tests failed");
+    cout << "slotted page compaction tests ok" << endl;
+
+    if (!test_slotted_page_slot_reuse())
+        return assertion_failure("slotted page slot reuse tests failed");
+    cout << "slotted page slot reuse tests ok" << endl;
+
 
     if (!test_slotted_page1())
         return assertion_failure("slotted page 1 tests failed");
@@ -577,6 +1461,20 @@ bool test_heap_storage() {
             return false;
     }
     cout << "del ok" << endl;
+    delete handles;
+
+    ValueDict where;
+    where["a"] = Value(500);
+    where["b"] = Value(b);
+    handles = table.select(&where);
+    if (handles->size() != 1 || !test_compare(table, (*handles)[0], 500, b))
+        return false;
+    delete handles;
+    where["b"] = Value("no such text");
+    handles = table.select(&where);
+    if (handles->size() != 0)
+        return false;
+    cout << "select where ok" << endl;
     table.drop();
     delete handles;
 
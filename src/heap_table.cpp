@@ -3,20 +3,39 @@
  * @author K Lundeen
  * @see Seattle University, CPSC5300
  */
+#include <algorithm>
 #include <cstring>
+#include <memory>
 #include "heap_table.h"
 
 using namespace std;
-typedef uint16_t u16;
+
+const uint HeapTable::TAIL_FLUSH_ROWS;
+const uint HeapTable::TAIL_FLUSH_MS;
 
 /**
  * Constructor
  * @param table_name
  * @param column_names
  * @param column_attributes
+ * @param block_size         size of the blocks in the table's file, if it gets created
+ * @param backend            kind of file to keep the table in
  */
-HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes) : DbRelation(
-        table_name, column_names, column_attributes), file(table_name) {
+HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                     uint block_size, Backend backend) : DbRelation(table_name, column_names, column_attributes),
+                                                         file(nullptr), codec(nullptr), tail(nullptr), tail_rows(0), tail_flushed(),
+                                                         flush_rows(TAIL_FLUSH_ROWS),
+                                                         flush_interval(TAIL_FLUSH_MS) {
+    if (backend == MMAP)
+        this->file = new MMapHeapFile(table_name, block_size);
+    else
+        this->file = new HeapFile(table_name, block_size);
+}
+
+HeapTable::~HeapTable() {
+    release_tail();
+    delete this->codec;
+    delete this->file;
 }
 
 /**
@@ -24,7 +43,12 @@ HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttr
  * Is not responsible for metadata storage or validation.
  */
 void HeapTable::create() {
-    file.create();
+    file->create();
+    unique_ptr<SlottedPage> page(file->get(1));
+    page->put_record_format(RowCodec::FORMAT);
+    file->put(page.get());
+    file->flush();  // the stamp goes out now, not with the first rows of the tail page
+    compile_codec();
 }
 
 /**
@@ -43,21 +67,37 @@ void HeapTable::create_if_not_exists() {
  * Execute: DROP TABLE <table_name>
  */
 void HeapTable::drop() {
-    file.drop();
+    release_tail();
+    file->drop();
 }
 
 /**
  * Open existing table. Enables: insert, update, delete, select, project
  */
 void HeapTable::open() {
-    file.open();
+    file->open();
+    compile_codec();
+}
+
+/**
+ * Work out the layout of the table's records, the first time the file is open (and its block size known).
+ * @throws DbRelationError if the file's records are not in the current layout
+ */
+void HeapTable::compile_codec() {
+    if (this->codec != nullptr)
+        return;
+    unique_ptr<SlottedPage> page(this->file->get(1));
+    if (page->get_record_format() != RowCodec::FORMAT)
+        throw DbRelationError(this->table_name + " was written in an older row format and must be recreated");
+    this->codec = new RowCodec(this->column_names, this->column_attributes, this->file->get_block_size());
 }
 
 /**
  * Closes the table. Disables: insert, update, delete, select, project
  */
 void HeapTable::close() {
-    file.close();
+    release_tail();
+    file->close();
 }
 
 /**
@@ -73,6 +113,45 @@ Handle HeapTable::insert(const ValueDict *row) {
     return handle;
 }
 
+/**
+ * Execute: INSERT INTO <table_name> (<row_keys>) VALUES (<row_values>), (<row_values>), ...
+ * Every row is validated and sized before any goes in; they then go into the tail page one after
+ * another, so each page is written back once however many of the rows it takes. If one still fails
+ * to go in, the ones before it are deleted again.
+ * @param rows dictionaries with column name keys
+ * @return the handles of the inserted rows, in order (freed by caller)
+ */
+Handles *HeapTable::insert_batch(const ValueDicts *rows) {
+    open();
+    ValueDicts full_rows;
+    std::vector<uint32_t> sizes;
+    try {
+        for (auto const &row: *rows) {
+            full_rows.push_back(validate(row));
+            sizes.push_back(this->codec->size(full_rows.back()));
+        }
+    } catch (...) {
+        for (auto full_row: full_rows)
+            delete full_row;
+        throw;
+    }
+    Handles *handles = new Handles();
+    try {
+        for (uint i = 0; i < full_rows.size(); i++)
+            handles->push_back(append(full_rows[i], sizes[i]));
+    } catch (...) {
+        for (auto const &handle: *handles)
+            del(handle);
+        delete handles;
+        for (auto full_row: full_rows)
+            delete full_row;
+        throw;
+    }
+    for (auto full_row: full_rows)
+        delete full_row;
+    return handles;
+}
+
 /**
  * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
  * where handle is sufficient to identify one specific record (e.g., returned from an insert
@@ -87,17 +166,16 @@ void HeapTable::update(const Handle handle, const ValueDict *new_values) {
 /**
  * Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
  * where handle is sufficient to identify one specific record (e.g., returned from an insert
- * or select).
+ * or select). The handle's record id goes back to its block for reuse by the next insert there.
  * @param handle the row to be deleted
  */
 void HeapTable::del(const Handle handle) {
     open();
     BlockID block_id = handle.first;
     RecordID record_id = handle.second;
-    SlottedPage *block = this->file.get(block_id);
+    unique_ptr<SlottedPage> block(this->file->get(block_id));
     block->del(record_id);
-    this->file.put(block);
-    delete block;
+    this->file->put(block.get());
 }
 
 /**
@@ -110,25 +188,29 @@ Handles *HeapTable::select() {
 
 /**
  * The select command
+ *
+ * Each block is fetched once, with the upcoming blocks being read ahead in the background, and the
+ * where conjunction is checked directly against the raw record bytes in that block, decoding only
+ * the predicate columns.
+ *
  * @param where predicates to match
  * @return list of handles of the selected rows
  */
 Handles *HeapTable::select(const ValueDict *where) {
     open();
     Handles *handles = new Handles();
-    BlockIDs *block_ids = file.block_ids();
-    for (auto const &block_id: *block_ids) {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id: *record_ids) {
-            Handle handle(block_id, record_id);
-            if (selected(handle, where))
-                handles->push_back(handle);
-        }
-        delete record_ids;
-        delete block;
+    Conjunction conjunction;
+    if (!compile(where, conjunction))
+        return handles;  // some predicate can never be satisfied
+    ReadAhead scan(*file, file->block_cursor());
+    for (;;) {
+        unique_ptr<SlottedPage> block(static_cast<SlottedPage *>(scan.next()));
+        if (block == nullptr)
+            break;
+        for (RecordID record_id: block->live_ids())
+            if (selected(block.get(), record_id, conjunction))
+                handles->push_back(Handle(block->get_block_id(), record_id));
     }
-    delete block_ids;
     return handles;
 }
 
@@ -141,10 +223,21 @@ Handles *HeapTable::select(const ValueDict *where) {
  * @return                  list of handles of the selected rows
  */
 Handles *HeapTable::select(Handles *current_selection, const ValueDict *where) {
+    open();
     Handles *handles = new Handles();
-    for (auto const &handle: *current_selection)
-        if (selected(handle, where))
+    Conjunction conjunction;
+    if (!compile(where, conjunction))
+        return handles;
+    unique_ptr<SlottedPage> block;
+    for (auto const &handle: *current_selection) {
+        // consecutive handles on the same block share one fetch
+        if (block == nullptr || block->get_block_id() != handle.first) {
+            block.reset();
+            block.reset(file->get(handle.first));
+        }
+        if (selected(block.get(), handle.second, conjunction))
             handles->push_back(handle);
+    }
     return handles;
 }
 
@@ -159,30 +252,84 @@ ValueDict *HeapTable::project(Handle handle) {
 
 /**
  * Project given columns from a given row.
+ * Only the asked-for columns are decoded, each straight from where the codec says it is.
  * @param handle row to be projected
  * @param column_names of columns to be included in the result
  * @return a sequence of values for handle given by column_names
+ * @throws DbRelationError if the row has been deleted
  */
 ValueDict *HeapTable::project(Handle handle, const ColumnNames *column_names) {
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage *block = file.get(block_id);
-    Dbt *data = block->get(record_id);
-    ValueDict *row = unmarshal(data);
-    delete data;
-    delete block;
+    open();
     if (column_names->empty())
-        return row;
+        column_names = &this->column_names;
+    std::vector<uint> col_nums = ordinals(*column_names);
+    unique_ptr<SlottedPage> block(file->get(handle.first));
+    RecordView record = block->view(handle.second);
+    if (record.is_deleted())
+        throw DbRelationError("no row " + to_string(handle.second) + " in block " + to_string(handle.first));
     ValueDict *result = new ValueDict();
-    for (auto const &column_name: *column_names) {
-        if (row->find(column_name) == row->end())
-            throw DbRelationError("table does not have column named '" + column_name + "'");
-        (*result)[column_name] = (*row)[column_name];
-    }
-    delete row;
+    for (uint i = 0; i < col_nums.size(); i++)
+        this->codec->get(record.data, col_nums[i], (*result)[(*column_names)[i]]);
     return result;
 }
 
+/**
+ * Project given columns from each of the given rows, into positional rows.
+ * The columns are resolved once for all the rows. The handles are visited in block order, whatever
+ * order they come in, so each block is fetched just once (with the next ones read ahead), and only
+ * the asked-for columns are decoded, straight into their places in the rows.
+ * @param handles       rows to be projected
+ * @param column_names  of columns to be included in the result (nullptr or empty for all)
+ * @param arena         where to allocate the rows (nullptr for the row set to have its own)
+ * @return              the rows, in the order of handles (freed by caller)
+ * @throws DbRelationError if one of the rows has been deleted
+ */
+RowSet *HeapTable::project_rows(Handles *handles, const ColumnNames *column_names, Arena *arena) {
+    open();
+    RowSet *rows = new_row_set(column_names, arena);
+    try {
+        std::vector<uint> col_nums = ordinals(rows->get_schema().get_column_names());
+        rows->add(handles->size());
+
+        std::vector<uint32_t> order(handles->size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        if (!is_sorted(handles->begin(), handles->end()))
+            stable_sort(order.begin(), order.end(),
+                        [handles](uint32_t a, uint32_t b) { return (*handles)[a].first < (*handles)[b].first; });
+        BlockIDs blocks;
+        for (auto i: order)
+            if (blocks.empty() || blocks.back() != (*handles)[i].first)
+                blocks.push_back((*handles)[i].first);
+
+        const uint window = ReadAhead::MAX_WINDOW;
+        uint block_num = 0;  // index into blocks of the current block
+        unique_ptr<SlottedPage> block;
+        for (auto i: order) {
+            const Handle &handle = (*handles)[i];
+            if (block == nullptr || block->get_block_id() != handle.first) {
+                if (block != nullptr)
+                    block_num++;
+                block.reset();
+                if (block_num % window == 0 && block_num + 1 < blocks.size())
+                    file->prefetch(blocks.data() + block_num + 1,
+                                   (uint) min<size_t>(window, blocks.size() - block_num - 1));
+                block.reset(file->get(handle.first));
+            }
+            RecordView record = block->view(handle.second);
+            if (record.is_deleted())
+                throw DbRelationError("no row " + to_string(handle.second) + " in block " + to_string(handle.first));
+            Row &row = (*rows)[i];
+            for (uint j = 0; j < col_nums.size(); j++)
+                this->codec->get(record.data, col_nums[j], row[j], rows->get_arena());
+        }
+    } catch (...) {
+        delete rows;
+        throw;
+    }
+    return rows;
+}
+
 /**
  * Check if the given row is acceptable to insert.
  * @param row to be validated
@@ -194,8 +341,10 @@ ValueDict *HeapTable::validate(const ValueDict *row) const {
     for (auto const &column_name: this->column_names) {
         Value value;
         ValueDict::const_iterator column = row->find(column_name);
-        if (column == row->end())
+        if (column == row->end()) {
+            delete full_row;
             throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+        }
         else
             value = column->second;
         (*full_row)[column_name] = value;
@@ -204,27 +353,100 @@ ValueDict *HeapTable::validate(const ValueDict *row) const {
 }
 
 /**
- * Appends a record to the file.
+ * Appends a row to the file.
  * @param row to be appended
  * @return handle of newly inserted row
  */
 Handle HeapTable::append(const ValueDict *row) {
-    Dbt *data = marshal(row);
-    SlottedPage *block = this->file.get(this->file.get_last_block_id());
+    return append(row, this->codec->size(row));
+}
+
+/**
+ * Adds a record to the file: into the tail page if it has room, else into the first block the free
+ * space map says has room for it (so space freed by deletes gets reused), else into a new block.
+ * That block becomes the new tail page. The row is marshaled directly into its place in the page.
+ * @param row   to be appended
+ * @param size  of its record, from the codec
+ * @return handle of newly inserted row
+ */
+Handle HeapTable::append(const ValueDict *row, uint32_t size) {
+    if (this->tail != nullptr && this->tail->largest_addable() < size)
+        release_tail();
+    if (this->tail == nullptr) {
+        this->tail = find_block(size);
+        this->tail_flushed = std::chrono::steady_clock::now();
+        tails().insert(this);
+    }
     RecordID record_id;
-    try {
-        record_id = block->add(data);
-    } catch (DbBlockNoRoomError &e) {
-        // need a new block
-        delete block;
-        block = this->file.get_new();
-        record_id = block->add(data);
+    this->codec->marshal(row, this->tail->reserve(size, record_id));
+    BlockID block_id = this->tail->get_block_id();
+    if (++this->tail_rows >= this->flush_rows ||
+        std::chrono::steady_clock::now() - this->tail_flushed >= this->flush_interval)
+        flush_tail();
+    return Handle(block_id, record_id);
+}
+
+/**
+ * Find a block with room for a record: the first one the free space map knows of, else a new one.
+ * @param size  of the record
+ * @return      the block (freed by caller)
+ */
+SlottedPage *HeapTable::find_block(uint32_t size) {
+    BlockID block_id;
+    while ((block_id = this->file->find_room(size)) != 0) {
+        unique_ptr<SlottedPage> block(this->file->get(block_id));
+        if (block->largest_addable() >= size)
+            return block.release();
+        // the map was behind; putting the block back corrects it
+        this->file->put(block.get());
     }
-    this->file.put(block);
-    delete block;
-    delete[] (char *) data->get_data();
-    delete data;
-    return Handle(this->file.get_last_block_id(), record_id);
+    return this->file->get_new();  // need a new block
+}
+
+/**
+ * Set when the tail page gets written back while inserts are still going into it.
+ * @param rows          after this many rows
+ * @param milliseconds  or when an insert comes this long after the last write back
+ */
+void HeapTable::set_tail_flush(uint rows, uint milliseconds) {
+    this->flush_rows = rows;
+    this->flush_interval = std::chrono::milliseconds(milliseconds);
+}
+
+/**
+ * Write back the tail page of every table that has one.
+ */
+void HeapTable::flush_all() {
+    for (auto table: tails())
+        table->flush_tail();
+}
+
+/**
+ * Write the tail page back to the file if rows have gone into it since the last time.
+ */
+void HeapTable::flush_tail() {
+    if (this->tail != nullptr && this->tail_rows > 0)
+        this->file->put(this->tail);
+    this->tail_rows = 0;
+    this->tail_flushed = std::chrono::steady_clock::now();
+}
+
+/**
+ * Write back and unpin the tail page.
+ */
+void HeapTable::release_tail() {
+    if (this->tail == nullptr)
+        return;
+    flush_tail();
+    delete this->tail;
+    this->tail = nullptr;
+    tails().erase(this);
+}
+
+// every table holding a tail page, for flush_all()
+std::set<HeapTable *> &HeapTable::tails() {
+    static std::set<HeapTable *> all;
+    return all;
 }
 
 /**
@@ -234,43 +456,10 @@ Handle HeapTable::append(const ValueDict *row) {
  * @return bits of the record as it should appear on disk
  */
 Dbt *HeapTable::marshal(const ValueDict *row) const {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("row too big to marshal");
-            *(int32_t *) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u_long size = value.s.length();
-            if (size > UINT16_MAX)
-                throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("row too big to marshal");
-            *(u16 *) (bytes + offset) = size;
-            offset += sizeof(u16);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("row too big to marshal");
-            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
-        }
-    }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
+    uint32_t size = this->codec->size(row);
+    char *bytes = new char[size];
+    this->codec->marshal(row, bytes);
+    return new Dbt(bytes, size);
 }
 
 /**
@@ -279,47 +468,63 @@ Dbt *HeapTable::marshal(const ValueDict *row) const {
  * @return row data for the tuple
  */
 ValueDict *HeapTable::unmarshal(Dbt *data) const {
+    return unmarshal(RecordView((const char *) data->get_data(), data->get_size()));
+}
+
+/**
+ * Figure out the memory data structures directly from the record's bytes within its block.
+ * Each TEXT field is copied exactly once, straight into its Value.
+ * @param record view of the file data for the tuple
+ * @return row data for the tuple
+ */
+ValueDict *HeapTable::unmarshal(const RecordView &record) const {
     ValueDict *row = new ValueDict();
-    Value value;
-    char *bytes = (char *) data->get_data();
-    uint offset = 0;
     uint col_num = 0;
-    for (auto const &column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        value.data_type = ca.get_data_type();
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t *) (bytes + offset);
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u16 size = *(u16 *) (bytes + offset);
-            offset += sizeof(u16);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = string(buffer);  // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t *) (bytes + offset);
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to unmarshal INT, TEXT, and BOOLEAN");
-        }
-        (*row)[column_name] = value;
-    }
+    for (auto const &column_name: this->column_names)
+        this->codec->get(record.data, col_num++, (*row)[column_name]);
     return row;
 }
 
 /**
- * See if the row at the given handle satisfies the given where clause
- * @param handle  row to check
- * @param where   conditions to check
- * @return        true if conditions met, false otherwise
+ * Resolve the where clause into (column number, value) pairs in column order.
+ * @param where        conditions to check (nullptr for none)
+ * @param conjunction  returned by reference: the resolved predicates
+ * @return             false if some predicate can never be satisfied (type mismatch)
+ * @throws DbRelationError if a predicate names an unknown column
  */
-bool HeapTable::selected(Handle handle, const ValueDict *where) {
+bool HeapTable::compile(const ValueDict *where, Conjunction &conjunction) const {
     if (where == nullptr)
         return true;
-    ValueDict *row = this->project(handle, where);
-    bool is_selected = *row == *where;
-    delete row;
-    return is_selected;
+    bool satisfiable = true;
+    for (auto const &predicate: *where) {
+        auto it = find(this->column_names.begin(), this->column_names.end(), predicate.first);
+        if (it == this->column_names.end())
+            throw DbRelationError("table does not have column named '" + predicate.first + "'");
+        uint col_num = (uint) (it - this->column_names.begin());
+        if (this->column_attributes[col_num].get_data_type() != predicate.second.get_data_type())
+            satisfiable = false;
+        conjunction.push_back(Conjunction::value_type(col_num, &predicate.second));
+    }
+    sort(conjunction.begin(), conjunction.end());
+    return satisfiable;
+}
+
+/**
+ * See if the given record satisfies the conjunction.
+ * Works on the marshaled bytes in place, looking only at the predicate columns.
+ * @param block        block holding the record
+ * @param record_id    record to check
+ * @param conjunction  predicates from compile()
+ * @return             true if conditions met, false otherwise
+ */
+bool HeapTable::selected(SlottedPage *block, RecordID record_id, const Conjunction &conjunction) const {
+    if (conjunction.empty())
+        return true;
+    RecordView record = block->view(record_id);
+    if (record.is_deleted())
+        return false;
+    for (auto const &predicate: conjunction)
+        if (!this->codec->equals(record.data, predicate.first, *predicate.second))
+            return false;
+    return true;
 }
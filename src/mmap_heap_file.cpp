@@ -0,0 +1,251 @@
+/**
+ * @file mmap_heap_file.cpp - implementation of MMapHeapFile
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mmap_heap_file.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param name
+ * @param block_size  size of the blocks if the file gets created (an existing file keeps its own)
+ */
+MMapHeapFile::MMapHeapFile(string name, uint block_size) : HeapFile(name, block_size), path(""), fd(-1),
+                                                           base(nullptr), mapped(0) {
+    const char *home;
+    _DB_ENV->get_home(&home);
+    this->path = string(home) + "/" + this->name + ".mmap";
+}
+
+/**
+ * Destructor. Closes the file if it is still open.
+ */
+MMapHeapFile::~MMapHeapFile() {
+    close();
+}
+
+/**
+ * Create physical file.
+ */
+void MMapHeapFile::create(void) {
+    mmap_open(true);
+    unique_ptr<SlottedPage> page(get_new()); // force one page to exist
+}
+
+/**
+ * Delete the physical file.
+ */
+void MMapHeapFile::drop(void) {
+    close();
+    this->fsm.drop();
+    ::unlink(this->path.c_str());
+}
+
+/**
+ * Open physical file.
+ */
+void MMapHeapFile::open(void) {
+    mmap_open(false);
+}
+
+/**
+ * Close the physical file, syncing the mapping out first.
+ * All the pages gotten from this file must have been deleted by now.
+ */
+void MMapHeapFile::close(void) {
+    if (this->closed)
+        return;
+    this->fsm.close();
+    ::msync(this->base, this->mapped, MS_SYNC);
+    ::munmap(this->base, RESERVE_BYTES);
+    ::close(this->fd);
+    this->base = nullptr;
+    this->mapped = 0;
+    this->fd = -1;
+    this->closed = true;
+}
+
+/**
+ * Write out the changed blocks of the mapping now.
+ */
+void MMapHeapFile::flush(void) {
+    if (!this->closed)
+        ::msync(this->base, this->mapped, MS_SYNC);
+}
+
+/**
+ * Allocate a new block for the file, growing the file and the mapping if need be.
+ * @return the new empty SlottedPage, pointing into the mapping
+ */
+SlottedPage *MMapHeapFile::get_new(void) {
+    BlockID block_id = this->last + 1;
+    grow(block_id);
+    Dbt data(address(block_id), this->block_size);
+    SlottedPage *page = new SlottedPage(data, block_id, true);
+    this->last = block_id;
+    header()->last = block_id;
+    note_free_space(page);
+    return page;
+}
+
+/**
+ * Get a block from the file.
+ * @param block_id
+ * @return          the given slotted page, pointing into the mapping (freed by caller)
+ * @throws BufferPoolError if there is no such block (as HeapFile::get does)
+ */
+SlottedPage *MMapHeapFile::get(BlockID block_id) {
+    if (block_id == 0 || block_id > this->last)
+        throw BufferPoolError("block " + to_string(block_id) + " is not in the file");
+    Dbt data(address(block_id), this->block_size);
+    return new SlottedPage(data, block_id, false);
+}
+
+/**
+ * Write a block back to the file. The page already is the mapping, so this only tidies it
+ * (or copies it in, for a block that was built somewhere else).
+ * @param block
+ */
+void MMapHeapFile::put(DbBlock *block) {
+    compact_if_fragmented(block);
+    note_free_space(block);
+    char *bytes = address(block->get_block_id());
+    if (block->get_data() != bytes)
+        memcpy(bytes, block->get_data(), this->block_size);
+}
+
+/**
+ * A scan is starting: tell the OS to read ahead aggressively over its blocks (MADV_SEQUENTIAL).
+ * @param cursor  the blocks of the scan
+ */
+void MMapHeapFile::begin_scan(const BlockCursor &cursor) {
+    advise(cursor, MADV_SEQUENTIAL);
+}
+
+/**
+ * The scan is over: put its blocks back to the default paging (MADV_NORMAL), so later point accesses
+ * don't drag in neighbours they have no use for.
+ * @param cursor  the blocks of the scan
+ */
+void MMapHeapFile::end_scan(const BlockCursor &cursor) {
+    advise(cursor, MADV_NORMAL);
+}
+
+/**
+ * Give the OS some advice about the pages of the mapping that hold a range of blocks.
+ * @param cursor  the blocks (only those in the mapping count)
+ * @param advice  for madvise(2)
+ */
+void MMapHeapFile::advise(const BlockCursor &cursor, int advice) const {
+    if (this->closed || cursor.at_end())
+        return;
+    size_t page_size = (size_t) ::sysconf(_SC_PAGESIZE);
+    // madvise wants the start aligned to a page of memory
+    size_t from = (size_t) cursor.get_position() * this->block_size / page_size * page_size;
+    size_t to = min((size_t) min(cursor.get_end(), this->last) + 1, this->mapped / this->block_size) * this->block_size;
+    if (from < to)
+        ::madvise(this->base + from, to - from, advice);
+}
+
+/**
+ * Ask the OS to start paging some blocks in (MADV_WILLNEED), one call per run of consecutive blocks.
+ * @param block_ids  the blocks, in the order they will be gotten
+ * @param count      how many
+ */
+void MMapHeapFile::prefetch(const BlockID *block_ids, uint count) {
+    uint i = 0;
+    while (i < count) {
+        uint run = 1;
+        while (i + run < count && block_ids[i + run] == block_ids[i] + run)
+            run++;
+        if (block_ids[i] <= this->last)
+            ::madvise(address(block_ids[i]), (size_t) min(run, this->last - block_ids[i] + 1) * this->block_size,
+                      MADV_WILLNEED);
+        i += run;
+    }
+}
+
+/**
+ * Open (and maybe create) the file, reserve the address range and map the file into it.
+ * If anything goes wrong, all of that is undone again (and a file just created is removed).
+ * @param create  create a new, empty file (fails if it already exists)
+ * @throws DbException if the file cannot be opened or is not one of ours
+ */
+void MMapHeapFile::mmap_open(bool create) {
+    if (!this->closed)
+        return;
+    int flags = create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR;
+    this->fd = ::open(this->path.c_str(), flags, 0644);
+    if (this->fd < 0)
+        throw DbException(("cannot open " + this->path + ": " + strerror(errno)).c_str(), errno);
+
+    try {
+        Header header{MAGIC, this->block_size, 0};
+        if (create) {
+            if (::pwrite(this->fd, &header, sizeof(header), 0) != sizeof(header) ||
+                ::ftruncate(this->fd, this->block_size) != 0)
+                throw DbException(("cannot initialize " + this->path).c_str(), errno);
+        } else if (::pread(this->fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != MAGIC) {
+            throw DbException((this->path + " is not a heap file").c_str(), EINVAL);
+        }
+        this->block_size = header.block_size;
+        this->last = header.last;
+
+        void *reserved = ::mmap(nullptr, RESERVE_BYTES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED)
+            throw DbException(("cannot reserve address space for " + this->path).c_str(), errno);
+        this->base = (char *) reserved;
+        this->mapped = 0;
+        grow(this->last);
+        fsm_open(create);
+    } catch (...) {
+        if (create)
+            this->fsm.drop();
+        else
+            this->fsm.close();
+        if (this->base != nullptr)
+            ::munmap(this->base, RESERVE_BYTES);
+        ::close(this->fd);
+        if (create)
+            ::unlink(this->path.c_str());
+        this->base = nullptr;
+        this->mapped = 0;
+        this->fd = -1;
+        throw;
+    }
+    this->closed = false;
+}
+
+/**
+ * Make sure the given block is in the file and mapped. The file is extended by at least doubling
+ * its mapped size, and the new part is mapped right after the old part so existing pages stay put.
+ * @param block_id  block that has to be addressable
+ * @throws DbRelationError if the file outgrows its address space reservation
+ */
+void MMapHeapFile::grow(BlockID block_id) {
+    size_t needed = ((size_t) block_id + 1) * this->block_size;
+    if (needed <= this->mapped)
+        return;
+    size_t page_size = (size_t) ::sysconf(_SC_PAGESIZE);
+    size_t target = max(needed, max(2 * this->mapped, 64 * (size_t) this->block_size));
+    target = (target + page_size - 1) / page_size * page_size;
+    if (target > RESERVE_BYTES)
+        throw DbRelationError(this->path + " is too big to map");
+
+    struct stat st;
+    if (::fstat(this->fd, &st) != 0 || ((size_t) st.st_size < target && ::ftruncate(this->fd, (off_t) target) != 0))
+        throw DbRelationError("cannot grow " + this->path + ": " + strerror(errno));
+    void *more = ::mmap(this->base + this->mapped, target - this->mapped, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_FIXED, this->fd, (off_t) this->mapped);
+    if (more == MAP_FAILED)
+        throw DbRelationError("cannot map " + this->path + ": " + strerror(errno));
+    this->mapped = target;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file read_ahead.cpp - implementation of ReadAhead
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#include <algorithm>
+#include <cmath>
+#include "read_ahead.h"
+
+using namespace std;
+
+// a get that takes longer than this was not already in memory
+static const double STALL_US = 20.0;
+
+/**
+ * Constructor
+ * @param file    file being scanned
+ * @param cursor  blocks to get
+ */
+ReadAhead::ReadAhead(DbFile &file, BlockCursor cursor) : file(file), range(cursor), cursor(cursor), ahead(cursor),
+                                                         upcoming(), window(MIN_WINDOW), fetch_us(0.0), work_us(0.0),
+                                                         last_get() {
+    this->file.begin_scan(this->range);
+}
+
+/**
+ * Destructor: the scan is over, whether or not it got to the end.
+ */
+ReadAhead::~ReadAhead() {
+    this->file.end_scan(this->range);
+}
+
+/**
+ * Get the next block of the scan, first topping up the prefetched window once half of it is used.
+ * @return  the block (freed by caller), or nullptr at the end of the scan
+ */
+DbBlock *ReadAhead::next() {
+    if (this->cursor.at_end())
+        return nullptr;
+    BlockID position = this->cursor.get_position();
+    if (!this->ahead.at_end() && this->ahead.get_position() <= position + this->window / 2) {
+        this->upcoming.clear();
+        while (!this->ahead.at_end() && this->ahead.get_position() < position + this->window)
+            this->upcoming.push_back(this->ahead.next());
+        if (!this->upcoming.empty())
+            this->file.prefetch(this->upcoming.data(), (uint) this->upcoming.size());
+    }
+
+    bool first = this->last_get == Clock::time_point();
+    Clock::time_point start = Clock::now();
+    DbBlock *block = this->file.get(this->cursor.next());
+    Clock::time_point end = Clock::now();
+    if (!first)
+        adapt(chrono::duration<double, micro>(end - start).count(),
+              chrono::duration<double, micro>(start - this->last_get).count());
+    this->last_get = end;
+    return block;
+}
+
+/**
+ * Fold one get into the running averages and resize the window.
+ * @param get_us  how long the get took
+ * @param gap_us  how long the caller spent since the previous get
+ */
+void ReadAhead::adapt(double get_us, double gap_us) {
+    const double weight = 0.125;
+    this->work_us += weight * (gap_us - this->work_us);
+    if (get_us > STALL_US)
+        this->fetch_us = this->fetch_us == 0.0 ? get_us : this->fetch_us + weight * (get_us - this->fetch_us);
+    double wanted = this->fetch_us / max(this->work_us, 1.0) + 1.0;
+    this->window = (uint) max((double) MIN_WINDOW, min((double) MAX_WINDOW, ceil(wanted)));
+}
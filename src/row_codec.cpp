@@ -0,0 +1,199 @@
+/**
+ * @file row_codec.cpp - implementation of RowCodec
+ *
+ * @see "Seattle University, CPSC5300, Winter Quarter 2024"
+ */
+#include <algorithm>
+#include <cstring>
+#include "row_codec.h"
+#include "slotted_page.h"
+
+using namespace std;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+/**
+ * Work out where each column goes.
+ * @param column_names       the table's columns
+ * @param column_attributes  their types
+ * @param block_size         size of the blocks the records are kept in
+ * @throws DbRelationError if a column is of a type we can't store
+ */
+RowCodec::RowCodec(const ColumnNames &column_names, const ColumnAttributes &column_attributes, uint block_size)
+        : column_names(column_names), fields(column_attributes.size()), by_name(column_names.size()),
+          offset_size(block_size > SlottedPage::MAX_NARROW_SZ ? sizeof(u32) : sizeof(u16)), fixed_size(0),
+          text_start(0), max_size(0) {
+    for (auto const &column_attribute: column_attributes) {
+        ColumnAttribute::DataType data_type = column_attribute.get_data_type();
+        if (data_type != ColumnAttribute::INT && data_type != ColumnAttribute::TEXT &&
+            data_type != ColumnAttribute::BOOLEAN)
+            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
+    }
+    for (uint col_num = 0; col_num < this->by_name.size(); col_num++)
+        this->by_name[col_num] = col_num;
+    sort(this->by_name.begin(), this->by_name.end(),
+         [this](uint a, uint b) { return this->column_names[a] < this->column_names[b]; });
+
+    // fixed columns first, INT ahead of BOOLEAN so the INTs stay aligned; then the TEXT end offsets
+    uint text_count = 0;
+    for (auto data_type: {ColumnAttribute::INT, ColumnAttribute::BOOLEAN, ColumnAttribute::TEXT}) {
+        for (uint col_num: this->by_name) {
+            if (column_attributes[col_num].get_data_type() != data_type)
+                continue;
+            Field &field = this->fields[col_num];
+            field.data_type = data_type;
+            if (data_type == ColumnAttribute::INT) {
+                field.offset = this->fixed_size;
+                this->fixed_size += sizeof(int32_t);
+            } else if (data_type == ColumnAttribute::BOOLEAN) {
+                field.offset = this->fixed_size;
+                this->fixed_size += sizeof(uint8_t);
+            } else {
+                field.offset = this->fixed_size + text_count++ * this->offset_size;  // fixed columns all came first
+            }
+        }
+    }
+    this->text_start = this->fixed_size + text_count * this->offset_size;
+    this->max_size = SlottedPage::max_record_size(block_size);
+}
+
+/**
+ * Number of bytes the given row marshals to.
+ * @param row  values for (at least) every column
+ * @return     size of the record
+ * @throws DbRelationError if a column is missing or the row is too big
+ */
+u32 RowCodec::size(const ValueDict *row) const {
+    u32 size = this->text_start;
+    each(row, [&size](uint col_num, const Field &field, const Value &value) {
+        if (field.data_type != ColumnAttribute::TEXT)
+            return;
+        if (value.text_size() > UINT16_MAX)
+            throw DbRelationError("text field too long to marshal");
+        size += value.text_size();
+    });
+    if (size > this->max_size)
+        throw DbRelationError("row too big to marshal");
+    return size;
+}
+
+/**
+ * Write the record for the given row.
+ * @param row    values for (at least) every column, already checked by size()
+ * @param bytes  where the record goes, size(row) bytes
+ */
+void RowCodec::marshal(const ValueDict *row, char *bytes) const {
+    u32 end = this->text_start;
+    bool wide = this->offset_size == sizeof(u32);
+    each(row, [bytes, &end, wide](uint col_num, const Field &field, const Value &value) {
+        switch (field.data_type) {
+            case ColumnAttribute::INT:
+                *(int32_t *) (bytes + field.offset) = value.get_int();
+                break;
+            case ColumnAttribute::BOOLEAN:
+                *(uint8_t *) (bytes + field.offset) = (uint8_t) value.get_int();
+                break;
+            default:
+                // the TEXT columns come in the same order as their end offsets
+                memcpy(bytes + end, value.text_data(), value.text_size());  // assume ascii for now
+                end += value.text_size();
+                if (wide)
+                    *(u32 *) (bytes + field.offset) = end;
+                else
+                    *(u16 *) (bytes + field.offset) = (u16) end;
+        }
+    });
+}
+
+/**
+ * Decode one column of a record.
+ * @param bytes    the record
+ * @param col_num  which column
+ * @param value    returned by reference
+ * @param arena    where to copy long TEXT to (nullptr for the value to have its own copy)
+ */
+void RowCodec::get(const char *bytes, uint col_num, Value &value, Arena *arena) const {
+    const Field &field = this->fields[col_num];
+    switch (field.data_type) {
+        case ColumnAttribute::INT:
+            value.set_int(*(int32_t *) (bytes + field.offset));
+            break;
+        case ColumnAttribute::BOOLEAN:
+            value.set_boolean(*(uint8_t *) (bytes + field.offset) != 0);
+            break;
+        default: {
+            const char *data;
+            u32 size;
+            text(bytes, col_num, data, size);
+            if (arena != nullptr && size > Value::SMALL_TEXT)
+                value.set_text_ref(arena->copy(data, size), size);
+            else
+                value.set_text(data, size);  // assume ascii for now
+        }
+    }
+}
+
+/**
+ * Compare one column of a record to a value, without decoding it.
+ * @param bytes    the record
+ * @param col_num  which column
+ * @param value    to compare against (of the column's type)
+ * @return         true if they are the same
+ */
+bool RowCodec::equals(const char *bytes, uint col_num, const Value &value) const {
+    const Field &field = this->fields[col_num];
+    switch (field.data_type) {
+        case ColumnAttribute::INT:
+            return *(int32_t *) (bytes + field.offset) == value.get_int();
+        case ColumnAttribute::BOOLEAN:
+            return *(uint8_t *) (bytes + field.offset) == (uint8_t) value.get_int();
+        default: {
+            const char *data;
+            u32 size;
+            text(bytes, col_num, data, size);
+            return size == value.text_size() && memcmp(data, value.text_data(), size) == 0;
+        }
+    }
+}
+
+/**
+ * Find the bytes of a TEXT column: from the end of the TEXT column before it (or the start of the
+ * TEXT bytes) to its own end.
+ * @param bytes    the record
+ * @param col_num  which column
+ * @param data     returned by reference: start of the column's bytes
+ * @param size     returned by reference: number of bytes
+ */
+void RowCodec::text(const char *bytes, uint col_num, const char *&data, u32 &size) const {
+    u32 offset = this->fields[col_num].offset;
+    u32 begin, end;
+    if (this->offset_size == sizeof(u32)) {
+        begin = offset == this->fixed_size ? this->text_start : *(u32 *) (bytes + offset - sizeof(u32));
+        end = *(u32 *) (bytes + offset);
+    } else {
+        begin = offset == this->fixed_size ? this->text_start : *(u16 *) (bytes + offset - sizeof(u16));
+        end = *(u16 *) (bytes + offset);
+    }
+    data = bytes + begin;
+    size = end - begin;
+}
+
+/**
+ * Call f(col_num, field, value) for each column, in order of column name. The row's map is walked
+ * once alongside the column names instead of being searched for each column.
+ * @param row  values for (at least) every column
+ * @param f    what to do with each
+ * @throws DbRelationError if a column is missing
+ */
+template<typename F>
+void RowCodec::each(const ValueDict *row, F f) const {
+    auto it = row->begin();
+    for (uint col_num: this->by_name) {
+        const Identifier &column_name = this->column_names[col_num];
+        while (it != row->end() && it->first < column_name)
+            ++it;
+        if (it == row->end() || it->first != column_name)
+            throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+        f(col_num, this->fields[col_num], it->second);
+    }
+}
@@ -96,7 +96,7 @@ Handle Tables::insert(const ValueDict *row) {
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError(row->at("table_name").s + " already exists");
+        throw DbRelationError(row->at("table_name").get_text() + " already exists");
     return HeapTable::insert(row);
 }
 
@@ -105,7 +105,7 @@ Handle Tables::insert(const ValueDict *row) {
 void Tables::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
-    Identifier table_name = row->at("table_name").s;
+    Identifier table_name = row->at("table_name").get_text();
     delete row;
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation *table = Tables::table_cache.at(table_name);
@@ -128,15 +128,15 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
         ValueDict *row = Tables::columns_table->project(
                 handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
 
-        Identifier column_name = (*row)["column_name"].s;
+        Identifier column_name = (*row)["column_name"].get_text();
         column_names.push_back(column_name);
 
         ColumnAttribute::DataType data_type;
-        if ((*row)["data_type"].s == "INT")
+        if ((*row)["data_type"].get_text() == "INT")
             data_type = ColumnAttribute::INT;
-        else if ((*row)["data_type"].s == "TEXT")
+        else if ((*row)["data_type"].get_text() == "TEXT")
             data_type = ColumnAttribute::TEXT;
-        else if ((*row)["data_type"].s == "BOOLEAN")
+        else if ((*row)["data_type"].get_text() == "BOOLEAN")
             data_type = ColumnAttribute::BOOLEAN;
         else
             throw DbRelationError("Unknown data type");
@@ -235,12 +235,12 @@ void Columns::create() {
 // Manually check that (table_name, column_name) is unique.
 Handle Columns::insert(const ValueDict *row) {
     // Check that datatype is acceptable
-    if (!is_acceptable_identifier(row->at("table_name").s))
-        throw DbRelationError("unacceptable table name '" + row->at("table_name").s + "'");
-    if (!is_acceptable_identifier(row->at("column_name").s))
-        throw DbRelationError("unacceptable column name '" + row->at("column_name").s + "'");
-    if (!is_acceptable_data_type(row->at("data_type").s))
-        throw DbRelationError("unacceptable data type '" + row->at("data_type").s + "'");
+    if (!is_acceptable_identifier(row->at("table_name").get_text()))
+        throw DbRelationError("unacceptable table name '" + row->at("table_name").get_text() + "'");
+    if (!is_acceptable_identifier(row->at("column_name").get_text()))
+        throw DbRelationError("unacceptable column name '" + row->at("column_name").get_text() + "'");
+    if (!is_acceptable_data_type(row->at("data_type").get_text()))
+        throw DbRelationError("unacceptable data type '" + row->at("data_type").get_text() + "'");
 
     // Try SELECT * FROM _columns WHERE table_name = row["table_name"] AND column_name = column_name["column_name"]
     // and it should return nothing
@@ -251,7 +251,7 @@ Handle Columns::insert(const ValueDict *row) {
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError("duplicate column " + row->at("table_name").s + "." + row->at("column_name").s);
+        throw DbRelationError("duplicate column " + row->at("table_name").get_text() + "." + row->at("column_name").get_text());
 
     return HeapTable::insert(row);
 }
@@ -304,8 +304,8 @@ Indices::Indices() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES())
 // Manually check constraints -- unique on (table, index, column)
 Handle Indices::insert(const ValueDict *row) {
     // Check that datatype is acceptable
-    if (!is_acceptable_identifier(row->at("index_name").s))
-        throw DbRelationError("unacceptable index name '" + row->at("index_name").s + "'");
+    if (!is_acceptable_identifier(row->at("index_name").get_text()))
+        throw DbRelationError("unacceptable index name '" + row->at("index_name").get_text() + "'");
 
     // Try SELECT * FROM _indices WHERE table_name = row["table_name"] AND index_name = row["index_name"]
     //     AND column_name = column_name["column_name"]
@@ -313,13 +313,13 @@ Handle Indices::insert(const ValueDict *row) {
     ValueDict where;
     where["table_name"] = row->at("table_name");
     where["index_name"] = row->at("index_name");
-    if (row->at("seq_in_index").n > 1)
+    if (row->at("seq_in_index").get_int() > 1)
         where["column_name"] = row->at("column_name");  // check for duplicate columns on the same index
     Handles *handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError("duplicate index " + row->at("table_name").s + " " + row->at("index_name").s);
+        throw DbRelationError("duplicate index " + row->at("table_name").get_text() + " " + row->at("index_name").get_text());
     return HeapTable::insert(row);
 }
 
@@ -328,8 +328,8 @@ Handle Indices::insert(const ValueDict *row) {
 void Indices::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
-    Identifier table_name = row->at("table_name").s;
-    Identifier index_name = row->at("index_name").s;
+    Identifier table_name = row->at("table_name").get_text();
+    Identifier index_name = row->at("index_name").get_text();
 	delete row;
     std::pair<Identifier, Identifier> cache_key(table_name, index_name);
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end()) {
@@ -354,13 +354,13 @@ void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNa
     for (auto const &handle: *handles) {
         ValueDict *row = project(handle);
 
-        Identifier column_name = (*row)["column_name"].s;
-        uint which = (uint) (*row)["seq_in_index"].n;
+        Identifier column_name = (*row)["column_name"].get_text();
+        uint which = (uint) (*row)["seq_in_index"].get_int();
         colnames[which - 1] = column_name;  // seq_in_index is 1-based
         if (which > size)
             size = which;
-        is_unique = (*row)["is_unique"].n != 0;
-        is_hash = (*row)["index_type"].s == "HASH";
+        is_unique = (*row)["is_unique"].get_int() != 0;
+        is_hash = (*row)["index_type"].get_text() == "HASH";
         delete row;
     }
     for (uint i = 0; i < size; i++)
@@ -419,7 +419,7 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     Handles *handles = select(&where);
     for (auto const &handle: *handles) {
         ValueDict *row = project(handle);
-        ret.push_back((*row)["index_name"].s);
+        ret.push_back((*row)["index_name"].get_text());
         delete row;
     }
     delete handles;
@@ -8,6 +8,7 @@
 
 using namespace std;
 typedef uint16_t u16;
+typedef uint32_t u32;
 
 /**
  * SlottedPage constructor
@@ -16,13 +17,11 @@ typedef uint16_t u16;
  * @param is_new
  */
 SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
-    if (is_new) {
-        this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
-        put_header();
-    } else {
-        get_header(this->num_records, this->end_free);
-    }
+    this->field_size = get_block_size() > MAX_NARROW_SZ ? sizeof(u32) : sizeof(u16);
+    if (is_new)
+        clear();
+    else if (get_field(FORMAT_FIELD) != FORMAT)
+        throw DbRelationError("block " + to_string(block_id) + " is not in the current page format");
 }
 
 /**
@@ -31,16 +30,38 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(bl
  * @return the new block's id
  */
 RecordID SlottedPage::add(const Dbt *data) {
-    if (!has_room((u16) data->get_size()))
+    RecordID id;
+    memcpy(reserve(data->get_size(), id), data->get_data(), data->get_size());
+    return id;
+}
+
+/**
+ * Add a new record of the given size to the block, for the caller to fill in.
+ * @param size       number of bytes in the record
+ * @param record_id  returned by reference: the new record's id
+ * @return           where to put the record's bytes (good until the page is next changed)
+ * @throws DbBlockNoRoomError if it won't fit
+ */
+char *SlottedPage::reserve(u32 size, RecordID &record_id) {
+    RecordID id = free_slot();
+    u32 header = id == 0 ? 2 * this->field_size : 0;  // a reused slot already has its header
+    if (size + header > this->unused_bytes() || (header != 0 && num_records() == UINT16_MAX))
         throw DbBlockNoRoomError("not enough room for new record");
-    u16 id = ++this->num_records;
-    u16 size = (u16) data->get_size();
-    this->end_free -= size;
-    u16 loc = this->end_free + 1U;
-    put_header();
+    if (size + header > contiguous_bytes())
+        compact();
+    if (id != 0) {
+        u32 next, loc;
+        get_header(next, loc, id);  // unlink it from the free chain
+        put_field(FREE_SLOT, next);
+    } else {
+        id = (RecordID) (num_records() + 1U);
+        put_field(NUM_RECORDS, id);
+    }
+    u32 loc = end_free() - size + 1U;
+    put_field(END_FREE, loc - 1U);
     put_header(id, size, loc);
-    memcpy(this->address(loc), data->get_data(), size);
-    return id;
+    record_id = id;
+    return (char *) this->address(loc);
 }
 
 /**
@@ -49,50 +70,77 @@ RecordID SlottedPage::add(const Dbt *data) {
  * @return the bits of the record as stored in the block, or nullptr if it has been deleted (freed by caller)
  */
 Dbt *SlottedPage::get(RecordID record_id) const {
-    u16 size, loc;
+    RecordView record = view(record_id);
+    if (record.is_deleted())
+        return nullptr;  // this is just a tombstone, record has been deleted
+    return new Dbt((void *) record.data, record.size);
+}
+
+/**
+ * Look at a record in place, without allocating or copying.
+ * @param record_id
+ * @return view of the bits of the record within the block (is_deleted() if it has been deleted)
+ */
+RecordView SlottedPage::view(RecordID record_id) const {
+    u32 size, loc;
     get_header(size, loc, record_id);
     if (loc == 0)
-        return nullptr;  // this is just a tombstone, record has been deleted
-    return new Dbt(this->address(loc), size);
+        return RecordView();
+    return RecordView((const char *) this->address(loc), size);
 }
 
 /**
  * Replace the record with the given data.
+ *
+ * A smaller record is overwritten in place; a larger one is moved to the free space (compacting
+ * first if that is the only way to fit it). Either way the abandoned bytes are just counted as fragmented.
+ *
  * @param record_id   record to replace
  * @param data        new contents of record_id
  * @throws DbBlockNoRoomError if it won't fit
  */
 void SlottedPage::put(RecordID record_id, const Dbt &data) {
-    u16 size, loc;
+    u32 size, loc;
     get_header(size, loc, record_id);
-    u16 new_size = (u16) data.get_size();
-    if (new_size > size) {
-        u16 extra = new_size - size;
-        if (!has_room(extra))
-            throw DbBlockNoRoomError("not enough room for enlarged record");
-        slide(loc, loc - extra);
-        memcpy(this->address(loc - extra), data.get_data(), new_size);
+    u32 new_size = data.get_size();
+    if (new_size <= size) {
+        memcpy(this->address(loc), data.get_data(), new_size);
+        put_field(FRAG_BYTES, fragmented_bytes() + size - new_size);
     } else {
+        if (new_size > this->unused_bytes() + size)
+            throw DbBlockNoRoomError("not enough room for enlarged record");
+        put_field(FRAG_BYTES, fragmented_bytes() + size);
+        if (new_size > contiguous_bytes()) {
+            put_header(record_id, 0, 0);  // leave the old copy out of the compaction
+            compact();
+        }
+        loc = end_free() - new_size + 1U;
+        put_field(END_FREE, loc - 1U);
         memcpy(this->address(loc), data.get_data(), new_size);
-        slide(loc + new_size, loc + size);
     }
-    get_header(size, loc, record_id);
     put_header(record_id, new_size, loc);
 }
 
 /**
  * Delete a record from the page.
  *
- * Mark the given id as deleted by changing its size to zero and its location to 0.
- * Compact the rest of the data in the block. But keep the record ids the same for everyone.
+ * Mark the given id as deleted by changing its location to 0 and putting it on the chain of reusable ids.
+ * The record's bytes are left where they are and counted as fragmented until the next compact().
+ * The other records keep their ids; this one is handed out again by a later add() or reserve().
+ * Deleting a record that is already deleted (or was never added) does nothing.
  *
  * @param record_id  record to delete
  */
 void SlottedPage::del(RecordID record_id) {
-    u16 size, loc;
+    if (record_id == 0 || record_id > num_records())
+        return;
+    u32 size, loc;
     get_header(size, loc, record_id);
-    put_header(record_id, 0, 0);  // 0 is the tombstone sentinel
-    slide(loc, loc + size);
+    if (loc == 0)
+        return;  // already a tombstone: its size is the free chain link
+    put_header(record_id, free_slot(), 0);  // 0 is the tombstone sentinel; link it into the free chain
+    put_field(FREE_SLOT, record_id);
+    put_field(FRAG_BYTES, fragmented_bytes() + size);
 }
 
 /**
@@ -101,12 +149,8 @@ void SlottedPage::del(RecordID record_id) {
  */
 RecordIDs *SlottedPage::ids(void) const {
     RecordIDs *vec = new RecordIDs();
-    u16 size, loc;
-    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
-        get_header(size, loc, record_id);
-        if (loc != 0)
-            vec->push_back(record_id);
-    }
+    for (RecordID record_id : live_ids())
+        vec->push_back(record_id);
     return vec;
 }
 
@@ -114,9 +158,12 @@ RecordIDs *SlottedPage::ids(void) const {
  * Erase all the records
  */
 void SlottedPage::clear() {
-    this->num_records = 0;
-    this->end_free = DbBlock::BLOCK_SZ - 1;
-    put_header();
+    put_field(FORMAT_FIELD, FORMAT);
+    put_field(NUM_RECORDS, 0);
+    put_field(END_FREE, get_block_size() - 1);
+    put_field(FRAG_BYTES, 0);
+    put_field(FREE_SLOT, 0);
+    put_field(RECORD_FORMAT, 0);
 }
 
 /**
@@ -124,119 +171,158 @@ void SlottedPage::clear() {
  * @return number of current records
  */
 u16 SlottedPage::size() const {
-    u16 size, loc;
     u16 count = 0;
-    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
-        get_header(size, loc, record_id);
+    for (auto it = live_ids().begin(), end = live_ids().end(); it != end; ++it)
+        count++;
+    return count;
+}
+
+/**
+ * Advance past any tombstones (stopping at one past the last record).
+ */
+void SlottedPage::IDIterator::skip_deleted() {
+    u32 size, loc;
+    for (RecordID last = this->page->num_records(); this->record_id <= last; this->record_id++) {
+        this->page->get_header(size, loc, this->record_id);
         if (loc != 0)
-            count++;
+            break;
     }
-    return count;
 }
 
 
 /**
- * Get the size and offset for given id. For id of zero, it is the block header.
+ * Get the size and offset for given id.
  * @param size  set to the size from given header
  * @param loc   set to the byte offset from given header
  * @param id    the id of the header to fetch
  */
-void SlottedPage::get_header(u_int16_t &size, u_int16_t &loc, RecordID id) const {
-    size = get_n((u16) 4 * id);
-    loc = get_n((u16) (4 * id + 2));
+void SlottedPage::get_header(u32 &size, u32 &loc, RecordID id) const {
+    u32 offset = header_offset(id);
+    size = get_n(offset);
+    loc = get_n(offset + this->field_size);
 }
 
 /**
- * Store the size and offset for given id. For id of zero, store the block header.
+ * Store the size and offset for given id.
  * @param id
  * @param size
  * @param loc
  */
-void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
-    if (id == 0) { // called the put_header() version and using the default params
-        size = this->num_records;
-        loc = this->end_free;
-    }
-    put_n((u16) 4 * id, size);
-    put_n((u16) (4 * id + 2), loc);
+void SlottedPage::put_header(RecordID id, u32 size, u32 loc) {
+    u32 offset = header_offset(id);
+    put_n(offset, size);
+    put_n(offset + this->field_size, loc);
 }
 
 /**
- * Calculate if we have room to store a record with given size. The size should include the 4 bytes
- * for the header, too, if this is an add.
- * @param size   size of the new record (not including the header space needed)
- * @return       true if there is enough room, false otherwise
+ * Byte offset of the given record's header.
+ * @param id  the id of the header
+ * @return    number of bytes into the page
  */
-bool SlottedPage::has_room(u16 size) const {
-    return size + (u16)4 <= this->unused_bytes();
+u32 SlottedPage::header_offset(RecordID id) const {
+    // block header is HEADER_FIELDS fields, each record header is two
+    return HEADER_FIELDS * this->field_size + 2 * this->field_size * (id - 1U);
 }
 
 /**
  * Get the number of bytes not currently used to store data or for overhead.
+ * Fragmented bytes count as unused since compact() can always reclaim them.
  * @return number of bytes
  */
-u16 SlottedPage::unused_bytes() const {
-    u16 headers = (u16) (4 * (this->num_records + 1));
-    u16 unused;
-    if (this->end_free <= headers)
-        unused = 0;
-    else
-        unused = this->end_free - headers;
-    return unused;
+u32 SlottedPage::unused_bytes() const {
+    return contiguous_bytes() + fragmented_bytes();
 }
 
 /**
- * Slide the contents to compensate for a smaller/larger record.
- *
- * If start < end, then remove data from offset start up to but not including offset end by sliding data
- * that is to the left of start to the right. If start > end, then make room for extra data from end to start
- * by sliding data that is to the left of start to the left.
- * Also fix up any record headers whose data has slid. Assumes there is enough room if it is a left
- * shift (end < start).
- *
- * @param start  beginning of slide
- * @param end    end of slide
+ * Get the size of the biggest record add() would take right now, allowing for its header and for
+ * running out of record ids.
+ * @return number of bytes
  */
-void SlottedPage::slide(u_int16_t start, u_int16_t end) {
-    int shift = end - start;
-    if (shift == 0)
-        return;
+u32 SlottedPage::largest_addable() const {
+    if (free_slot() != 0)
+        return this->unused_bytes();
+    u32 header = 2 * this->field_size;
+    if (num_records() == UINT16_MAX || this->unused_bytes() < header)
+        return 0;
+    return this->unused_bytes() - header;
+}
 
-    // slide data
-    void *to = this->address((u16) (this->end_free + 1 + shift));
-    void *from = this->address((u16) (this->end_free + 1));
-    int bytes = start - (this->end_free + 1U);
-    memmove(to, from, bytes);
+/**
+ * Get the size of the biggest record an empty page of the given size can hold.
+ * @param block_size  size of the page
+ * @return            number of bytes
+ */
+u32 SlottedPage::max_record_size(uint block_size) {
+    u32 field_size = block_size > MAX_NARROW_SZ ? sizeof(u32) : sizeof(u16);
+    // as contiguous_bytes() counts it, less the block header and the record's own header
+    return block_size - 1 - (HEADER_FIELDS + 2) * field_size;
+}
 
-    // fix up headers to the right
-    RecordIDs *record_ids = ids();
-    for (auto const &record_id : *record_ids) {
-        u16 size, loc;
+/**
+ * Get the number of bytes each record takes in a page of the given size over and above its own (its header).
+ * @param block_size  size of the page
+ * @return            number of bytes
+ */
+u32 SlottedPage::record_header_size(uint block_size) {
+    return 2 * (block_size > MAX_NARROW_SZ ? sizeof(u32) : sizeof(u16));
+}
+
+/**
+ * Get the number of bytes between the record headers and the record data (usable without compaction).
+ * @return number of bytes
+ */
+u32 SlottedPage::contiguous_bytes() const {
+    u32 headers = header_offset(num_records() + 1U);
+    u32 end = end_free();
+    if (end <= headers)
+        return 0;
+    return end - headers;
+}
+
+/**
+ * Squeeze out the fragmented bytes left behind by del() and put().
+ *
+ * All the live records are packed up against the end of the block in one pass and their headers fixed up.
+ * Record ids stay the same for everyone.
+ */
+void SlottedPage::compact() {
+    if (fragmented_bytes() == 0)
+        return;
+    u32 block_size = get_block_size();
+    char *buffer = new char[block_size];
+    u32 end = block_size;
+    for (RecordID record_id : live_ids()) {
+        u32 size, loc;
         get_header(size, loc, record_id);
-        if (loc <= start) {
-            loc += shift;
-            put_header(record_id, size, loc);
-        }
+        end -= size;
+        memcpy(buffer + end, this->address(loc), size);
+        put_header(record_id, size, end);
     }
-    delete record_ids;
-    this->end_free += shift;
-    put_header();
+    memcpy(this->address(end), buffer + end, block_size - end);
+    delete[] buffer;
+    put_field(END_FREE, end - 1U);
+    put_field(FRAG_BYTES, 0);
 }
 
 /**
- * Get 2-byte integer at given offset in block.
+ * Get a header field (2-byte integer, or 4-byte for the wide layout) at given offset in block.
  */
-u16 SlottedPage::get_n(u16 offset) const {
+u32 SlottedPage::get_n(u32 offset) const {
+    if (this->field_size == sizeof(u32))
+        return *(u32 *) this->address(offset);
     return *(u16 *) this->address(offset);
 }
 
 /**
- * Put a 2-byte integer at given offset in block.
+ * Put a header field (2-byte integer, or 4-byte for the wide layout) at given offset in block.
  * @param offset number of bytes into the page
  * @param n
  */
-void SlottedPage::put_n(u16 offset, u16 n) {
-    *(u16 *) this->address(offset) = n;
+void SlottedPage::put_n(u32 offset, u32 n) {
+    if (this->field_size == sizeof(u32))
+        *(u32 *) this->address(offset) = n;
+    else
+        *(u16 *) this->address(offset) = (u16) n;
 }
 
 /**
@@ -244,7 +330,7 @@ void SlottedPage::put_n(u16 offset, u16 n) {
  * @param offset
  * @return
  */
-void *SlottedPage::address(u16 offset) const {
+void *SlottedPage::address(u32 offset) const {
     return (void *) ((char *) this->block.get_data() + offset);
 }
 
@@ -20,6 +20,11 @@ using namespace hsql;
  */
 void initialize_environment(char *envHome);
 
+/*
+ * echo a statement, run it and print its result (or error)
+ */
+void run(const SQLStatement *statement);
+
 
 /**
  * Main entry point of the sql5300 program
@@ -54,6 +59,11 @@ int main(int argc, char *argv[]) {
             cout << (test_btree() ? "ok" : "failed") << endl;
             continue;
         }
+        if (query == "bench") {
+            cout << "Benchmark Btree interior node search: " << endl;
+            cout << (benchmark_btree() ? "ok" : "failed") << endl;
+            continue;
+        }
 
         // parse and execute
         SQLParserResult *parse = SQLParser::parseSQLString(query);
@@ -63,13 +73,29 @@ int main(int argc, char *argv[]) {
         } else {
             for (uint i = 0; i < parse->size(); ++i) {
                 const SQLStatement *statement = parse->getStatement(i);
+                // a run of INSERTs into the same table (INSERT ...; INSERT ...; ...) goes in as one batch
+                vector<const InsertStatement *> inserts;
+                for (uint j = i; j < parse->size() && parse->getStatement(j)->type() == kStmtInsert; ++j) {
+                    auto insert = (const InsertStatement *) parse->getStatement(j);
+                    if (!inserts.empty() && string(insert->tableName) != inserts.front()->tableName)
+                        break;
+                    inserts.push_back(insert);
+                }
+                if (inserts.size() < 2) {
+                    run(statement);
+                    continue;
+                }
+                cout << ParseTreeToString::statement(statement) << " ... (" << inserts.size() << " INSERTs)" << endl;
+                i += inserts.size() - 1;
                 try {
-                    cout << ParseTreeToString::statement(statement) << endl;
-                    QueryResult *result = SQLExec::execute(statement);
+                    QueryResult *result = SQLExec::execute(inserts);
                     cout << *result << endl;
                     delete result;
                 } catch (SQLExecError &e) {
-                    cout << "Error: " << e.what() << endl;
+                    // none of the batch went in; go through it again a statement at a time, so that the good
+                    // ones still go in and each bad one gets its own error
+                    for (auto insert: inserts)
+                        run(insert);
                 }
             }
         }
@@ -78,6 +104,17 @@ int main(int argc, char *argv[]) {
     return EXIT_SUCCESS;
 }
 
+void run(const SQLStatement *statement) {
+    cout << ParseTreeToString::statement(statement) << endl;
+    try {
+        QueryResult *result = SQLExec::execute(statement);
+        cout << *result << endl;
+        delete result;
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+}
+
 DbEnv *_DB_ENV;
 
 void initialize_environment(char *envHome) {
@@ -87,7 +124,7 @@ void initialize_environment(char *envHome) {
     env->set_message_stream(&cout);
     env->set_error_stream(&cerr);
     try {
-        env->open(envHome, DB_CREATE | DB_INIT_MPOOL, 0);
+        env->open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
     } catch (DbException &exc) {
         cerr << "(sql5300: " << exc.what() << ")" << endl;
         exit(1);
@@ -29,17 +29,17 @@ ostream &operator<<(ostream &out, const QueryResult &qres) {
         for (unsigned int i = 0; i < qres.column_names->size(); i++) out << "----------+";
         out << endl;
         for (auto const &row : *qres.rows) {
-            for (auto const &column_name : *qres.column_names) {
-                Value value = row->at(column_name);
-                switch (value.data_type) {
+            for (uint i = 0; i < row.size(); i++) {
+                const Value &value = row[i];
+                switch (value.get_data_type()) {
                     case ColumnAttribute::INT:
-                        out << value.n;
+                        out << value.get_int();
                         break;
                     case ColumnAttribute::TEXT:
-                        out << "\"" << value.s << "\"";
+                        out << "\"" << value << "\"";
                         break;
                     case ColumnAttribute::BOOLEAN:
-                        out << (value.n == 0 ? "false" : "true");
+                        out << (value.get_boolean() ? "true" : "false");
                         break;
                     default:
                         out << "???";
@@ -56,96 +56,154 @@ ostream &operator<<(ostream &out, const QueryResult &qres) {
 QueryResult::~QueryResult() {
     if (column_names) delete column_names;
     if (column_attributes) delete column_attributes;
-    if (rows) {
-        for (auto row : *rows) delete row;
-        delete rows;
-    }
+    if (rows) delete rows;
+    delete arena;  // after the rows, which may be in it
 }
 
 QueryResult *SQLExec::execute(const SQLStatement *statement) {
     if (!tables) tables = new Tables();
     if (!indices) indices = new Indices();
+    // the statement's temporaries live here, to go all at once along with the result
+    Arena *arena = new Arena();
+    QueryResult *result;
     try {
         switch (statement->type()) {
             case kStmtCreate:
-                return create((const CreateStatement *)statement);
+                result = create((const CreateStatement *)statement);
+                break;
             case kStmtDrop:
-                return drop((const DropStatement *)statement);
+                result = drop((const DropStatement *)statement);
+                break;
             case kStmtShow:
-                return show((const ShowStatement *)statement);
+                result = show((const ShowStatement *)statement);
+                break;
             case kStmtInsert:
-                return insert((const InsertStatement *) statement);
+                result = insert((const InsertStatement *) statement);
+                break;
             case kStmtDelete:
-                return del((const DeleteStatement *) statement);
+                result = del((const DeleteStatement *) statement);
+                break;
             case kStmtSelect:
-                return select((const SelectStatement *) statement);
+                result = select((const SelectStatement *) statement, arena);
+                break;
             default:
-                return new QueryResult("not implemented");
+                result = new QueryResult("not implemented");
         }
+    } catch (DbRelationError &e) {
+        delete arena;
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    } catch (...) {
+        delete arena;
+        throw;
+    }
+    result->set_arena(arena);
+    HeapTable::flush_all();   // a statement's changes reach the files before we report back
+    BufferPool::flush_all();
+    return result;
+}
+
+QueryResult *SQLExec::execute(const std::vector<const InsertStatement *> &statements) {
+    if (!tables) tables = new Tables();
+    if (!indices) indices = new Indices();
+    QueryResult *result;
+    try {
+        result = insert(statements);
     } catch (DbRelationError &e) {
         throw SQLExecError(string("DbRelationError: ") + e.what());
     }
+    HeapTable::flush_all();   // the batch is one statement as far as flushing goes
+    BufferPool::flush_all();
+    return result;
 }
 
 QueryResult *SQLExec::insert(const InsertStatement *statement) {
-    validate_table(statement->tableName, true);
+    return insert(std::vector<const InsertStatement *>(1, statement));
+}
 
-    Identifier table_name = statement->tableName;
+QueryResult *SQLExec::insert(const std::vector<const InsertStatement *> &statements) {
+    const InsertStatement *first = statements.front();
+    validate_table(first->tableName, true);
+
+    Identifier table_name = first->tableName;
     // get the table from _tables
     DbRelation& table = tables->get_table(table_name);
-    ColumnAttributes column_attributes;
-    ColumnNames column_names;
-    unsigned int index = 0;
-
-    // if column names specified in the statement: INSERT INTO table_name (column1, column2, column3, ...) VALUES
-    // add to column names, otherwise add all column names
-    if(statement->columns != nullptr){
-        for (auto const col : *statement->columns){
-            column_names.push_back(col);
-        }
-    }
-    else {
-        for (auto const col: table.get_column_names()){
-            column_names.push_back(col);
-        }
-    }
-
-    if(column_names.size() != statement->values->size()) {
-        throw SQLExecError(string("DbRelationError: Unmatching columns and values."));
-    }
-
     IndexNames index_names = indices->get_index_names(table_name);
-    ValueDict row; // row to be added
+
+    ValueDicts rows; // rows to be added
+    Handles *handles = nullptr;
+    std::vector<DbIndex *> indexed;  // indices the rows have gone into
     try {
-        for (unsigned int i = 0; i < column_names.size(); ++i) {
-            Expr *value_expr = (*statement->values)[i];
-            switch (value_expr->type) {
-                case kExprLiteralInt:
-                    row[column_names[i]] = Value(value_expr->ival);
-                    break;
-                case kExprLiteralString:
-                    row[column_names[i]] = Value(value_expr->name);
-                    break;
-                default:
-                    throw SQLExecError("Not supported data type");
+        for (auto const statement : statements) {
+            if (table_name != statement->tableName)
+                throw SQLExecError("a batch of inserts must all go into the same table");
+            ColumnNames column_names;
+
+            // if column names specified in the statement: INSERT INTO table_name (column1, column2, column3, ...) VALUES
+            // add to column names, otherwise add all column names
+            if(statement->columns != nullptr){
+                for (auto const &col : *statement->columns){
+                    column_names.push_back(col);
+                }
+            }
+            else {
+                for (auto const &col: table.get_column_names()){
+                    column_names.push_back(col);
+                }
+            }
+
+            if(column_names.size() != statement->values->size()) {
+                throw SQLExecError(string("DbRelationError: Unmatching columns and values."));
+            }
+
+            ValueDict *row = new ValueDict();
+            rows.push_back(row);
+            for (unsigned int i = 0; i < column_names.size(); ++i) {
+                Expr *value_expr = (*statement->values)[i];
+                switch (value_expr->type) {
+                    case kExprLiteralInt:
+                        (*row)[column_names[i]] = Value(value_expr->ival);
+                        break;
+                    case kExprLiteralString:
+                        (*row)[column_names[i]] = Value(value_expr->name);
+                        break;
+                    default:
+                        throw SQLExecError("Not supported data type");
+                }
             }
         }
 
-        Handle handle = table.insert(&row);
+        handles = table.insert_batch(&rows);
 
         for (const auto &index_name : index_names) {
             DbIndex &index = indices->get_index(table_name, index_name);
-            index.insert(handle);
+            index.insert_batch(handles);
+            indexed.push_back(&index);
         }
     } catch (exception &e) {
+        // the failed insert_batch() took back its own part; take the rows out of everything else
+        if (handles != nullptr) {
+            try {
+                for (auto index : indexed)
+                    for (auto const &handle : *handles)
+                        index->del(handle);
+                for (auto const &handle : *handles)
+                    table.del(handle);
+            } catch (...) {}
+        }
+        for (auto row : rows)
+            delete row;
+        delete handles;
         throw SQLExecError(string("Insertion failed: ") + e.what());
     }
+    for (auto row : rows)
+        delete row;
+    delete handles;
 
-    string message = "successfully inserted 1 row into " + table_name;
+    string message = "successfully inserted " + to_string(rows.size()) + (rows.size() == 1 ? " row" : " rows") +
+                     " into " + table_name;
     if (index_names.size() > 0)
         message += " and " + to_string(index_names.size()) + " indices";
 
-    // del handle;
     return new QueryResult(message); 
 }
 
@@ -209,7 +267,7 @@ QueryResult* SQLExec::del(const DeleteStatement* statement) {
     return new QueryResult(output);
 }
 
-QueryResult *SQLExec::select(const SelectStatement *statement) {
+QueryResult *SQLExec::select(const SelectStatement *statement, Arena *arena) {
     string table_name = statement->fromTable->name;
     DbRelation &table = tables->get_table(table_name); // prefer polymorphism
 
@@ -226,14 +284,17 @@ QueryResult *SQLExec::select(const SelectStatement *statement) {
         if (statement->selectList->at(0)->type != kExprStar) {
             ColumnNames *projection = get_select_projection(statement->selectList, table.get_column_names());
             plan = new EvalPlan(projection, plan);
-            column_names = projection;
+            delete column_names;
+            column_names = new ColumnNames(*projection);  // the plan owns projection
         } else {
             plan = new EvalPlan(EvalPlan::ProjectAll, plan);
         }
     }
 
     EvalPlan *optimized = plan->optimize();
-    ValueDicts *rows = optimized->evaluate();
+    RowSet *rows = optimized->evaluate(arena);
+    delete optimized;
+    delete plan;
 
     return new QueryResult(column_names, column_attributes, rows, "successfully returned " + to_string(rows->size()) + " rows\n");
 }
@@ -298,19 +359,18 @@ QueryResult *SQLExec::show(const ShowStatement *statement) {
 QueryResult *SQLExec::show_tables() {
     ColumnAttributes *column_attributes = new ColumnAttributes();
     ColumnNames *column_names = new ColumnNames();
-    ValueDicts *rows = new ValueDicts();
+    tables->get_columns(Tables::TABLE_NAME, *column_names, *column_attributes);
+    RowSet *rows = new RowSet(*column_names, *column_attributes);
 
     Handles *handles = tables->select();
     for (Handle const &handle : *handles) {
         ValueDict *row = tables->project(handle);
-        if (row->at(TABLE_NAME_COLUMN).s != Columns::TABLE_NAME &&
-            row->at(TABLE_NAME_COLUMN).s != Tables::TABLE_NAME &&
-            row->at(TABLE_NAME_COLUMN).s != Indices::TABLE_NAME)
-            rows->emplace_back(row);
-        else
-            delete row;
+        if (row->at(TABLE_NAME_COLUMN).get_text() != Columns::TABLE_NAME &&
+            row->at(TABLE_NAME_COLUMN).get_text() != Tables::TABLE_NAME &&
+            row->at(TABLE_NAME_COLUMN).get_text() != Indices::TABLE_NAME)
+            rows->add(*row);
+        delete row;
     }
-    tables->get_columns(Tables::TABLE_NAME, *column_names, *column_attributes);
 
     delete handles;
 
@@ -321,7 +381,6 @@ QueryResult *SQLExec::show_tables() {
 QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     ColumnAttributes *column_attributes = new ColumnAttributes();
     ColumnNames *column_names = new ColumnNames();
-    ValueDicts *rows = new ValueDicts();
 
     Columns *columns = dynamic_cast<Columns *>(&tables->get_table(Columns::TABLE_NAME));
     for (auto const &column_name : columns->get_column_names())
@@ -330,7 +389,7 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     ValueDict where;
     where[TABLE_NAME_COLUMN] = Value(statement->tableName);
     Handles *handles = columns->select(&where);
-    for (Handle const &handle : *handles) rows->emplace_back(columns->project(handle));
+    RowSet *rows = columns->project_rows(handles, column_names);
 
     delete handles;
 
@@ -341,7 +400,6 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
 QueryResult *SQLExec::show_index(const ShowStatement *statement) {
     ColumnAttributes *column_attributes = new ColumnAttributes();
     ColumnNames *column_names = new ColumnNames();
-    ValueDicts *rows = new ValueDicts();
 
     for (auto const &column_name : indices->get_column_names())
         column_names->emplace_back(column_name);
@@ -349,7 +407,7 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement) {
     ValueDict where;
     where[TABLE_NAME_COLUMN] = Value(statement->tableName);
     Handles *handles = indices->select(&where);
-    for (Handle const &handle : *handles) rows->emplace_back(indices->project(handle));
+    RowSet *rows = indices->project_rows(handles, column_names);
 
     delete handles;
 
@@ -531,7 +589,7 @@ ValueDict *SQLExec::get_where_conjunction(const hsql::Expr *where_clause, const
         if (col_it == col_def.end()) {
             throw SQLExecError("Could not find column " + item.first);
         }
-        if (col_def[item.first].get_data_type() != item.second.data_type) {
+        if (col_def[item.first].get_data_type() != item.second.get_data_type()) {
             throw SQLExecError("Column: " + item.first + "'s data type does not match expected datatype");
         }
     }
@@ -6,12 +6,119 @@
 #include <algorithm>
 #include "storage_engine.h"
 
+static_assert(sizeof(Value) == 16, "Value should fit in 16 bytes");
+
+Value::Value(const Value &other) {
+    memcpy(this->bytes, other.bytes, sizeof(this->bytes));
+    if (other.is_long_text())
+        init_text(other.heap.chars, other.heap.size);
+}
+
+Value::Value(Value &&temp) {
+    memcpy(this->bytes, temp.bytes, sizeof(this->bytes));
+    temp.number = 0;  // the long TEXT, if any, is ours now
+    temp.set_tag(ColumnAttribute::INT);
+}
+
+Value &Value::operator=(const Value &other) {
+    if (this == &other)
+        return *this;
+    if (other.get_data_type() == ColumnAttribute::TEXT) {
+        set_text(other.text_data(), other.text_size());
+    } else {
+        release();
+        memcpy(this->bytes, other.bytes, sizeof(this->bytes));
+    }
+    return *this;
+}
+
+Value &Value::operator=(Value &&temp) {
+    if (this == &temp)
+        return *this;
+    release();
+    memcpy(this->bytes, temp.bytes, sizeof(this->bytes));
+    temp.number = 0;
+    temp.set_tag(ColumnAttribute::INT);
+    return *this;
+}
+
+void Value::set_int(int32_t n) {
+    release();
+    this->number = n;
+    set_tag(ColumnAttribute::INT);
+}
+
+void Value::set_boolean(bool b) {
+    release();
+    this->number = b ? 1 : 0;
+    set_tag(ColumnAttribute::BOOLEAN);
+}
+
+/**
+ * Make this a TEXT value holding a copy of the given characters.
+ * An existing long TEXT allocation is reused if it is big enough.
+ * @param data  the characters
+ * @param size  how many
+ */
+void Value::set_text(const char *data, size_t size) {
+    if (is_owned_text() && size > SMALL_TEXT && size <= this->heap.size) {
+        memmove(this->heap.chars, data, size);
+        this->heap.size = (uint32_t) size;
+        return;
+    }
+    char *old_chars = is_owned_text() ? this->heap.chars : nullptr;  // data might be some of them
+    set_tag(ColumnAttribute::TEXT);
+    init_text(data, size);
+    delete[] old_chars;
+}
+
+/**
+ * Make this a TEXT value for the given characters without copying them (if they are too many to
+ * keep inline). They have to stay put for as long as this Value (or anything moved from it) is used.
+ * @param data  the characters
+ * @param size  how many
+ */
+void Value::set_text_ref(const char *data, size_t size) {
+    if (size <= SMALL_TEXT) {
+        set_text(data, size);
+        return;
+    }
+    release();
+    set_tag(ColumnAttribute::TEXT);
+    this->heap.chars = const_cast<char *>(data);
+    this->heap.size = (uint32_t) size;
+    this->bytes[14] = (char) TEXT_REF;
+}
+
+// Hold the given characters (the tag is already set to TEXT and there is nothing to release)
+void Value::init_text(const char *data, size_t size) {
+    if (size <= SMALL_TEXT) {
+        memmove(this->bytes, data, size);
+        this->bytes[14] = (char) size;
+    } else {
+        char *chars = new char[size];
+        memcpy(chars, data, size);
+        this->heap.chars = chars;
+        this->heap.size = (uint32_t) size;
+        this->bytes[14] = (char) LONG_TEXT;
+    }
+}
+
+// Free the long TEXT, if that is what this holds
+void Value::release() {
+    if (is_owned_text())
+        delete[] this->heap.chars;
+    if (is_long_text())
+        this->bytes[14] = 0;
+}
+
 bool Value::operator==(const Value &other) const {
-    if (this->data_type != other.data_type)
+    if (this->get_data_type() != other.get_data_type())
         return false;
-    if (this->data_type == ColumnAttribute::INT)
-        return this->n == other.n;
-    return this->s == other.s;
+    if (this->get_data_type() != ColumnAttribute::TEXT)
+        return this->number == other.number;
+    uint32_t size = this->text_size();
+    return size == other.text_size() && memcmp(this->text_data(), other.text_data(), size) == 0;
 }
 
 bool Value::operator!=(const Value &other) const {
@@ -19,50 +126,114 @@ bool Value::operator!=(const Value &other) const {
 }
 
 bool Value::operator<(const Value &other) const {
-    if (this->data_type != other.data_type) {
+    ColumnAttribute::DataType data_type = this->get_data_type();
+    if (data_type != other.get_data_type()) {
         // arbitrary ordering of data types: BOOLEAN < INT < TEXT
-        if (this->data_type == ColumnAttribute::BOOLEAN)
+        if (data_type == ColumnAttribute::BOOLEAN)
             return true;
-        if (other.data_type == ColumnAttribute::BOOLEAN)
+        if (other.get_data_type() == ColumnAttribute::BOOLEAN)
             return false;
-        if (this->data_type == ColumnAttribute::INT)
+        if (data_type == ColumnAttribute::INT)
             return true;
-        if (other.data_type == ColumnAttribute::INT)
+        if (other.get_data_type() == ColumnAttribute::INT)
             return false;
         return false; // should never reach this
     }
-    if (this->data_type == ColumnAttribute::TEXT)
-        return this->s < other.s;
-    return this->n < other.n;
+    if (data_type == ColumnAttribute::TEXT) {
+        uint32_t size = this->text_size(), other_size = other.text_size();
+        int cmp = memcmp(this->text_data(), other.text_data(), std::min(size, other_size));
+        return cmp < 0 || (cmp == 0 && size < other_size);
+    }
+    return this->number < other.number;
 }
 
 std::ostream &operator<<(std::ostream &out, const Value &value) {
-    if (value.data_type == ColumnAttribute::DataType::TEXT)
-        out << value.s;
-    else if (value.data_type == ColumnAttribute::DataType::INT)
-        out << value.n;
-    else if (value.n)
+    if (value.get_data_type() == ColumnAttribute::DataType::TEXT)
+        out.write(value.text_data(), value.text_size());
+    else if (value.get_data_type() == ColumnAttribute::DataType::INT)
+        out << value.number;
+    else if (value.number)
         out << "true";
     else
         out << "false";
     return out;
 }
 
+// Position of the given column in the schema
+uint Schema::ordinal(const Identifier &column_name) const {
+    auto it = std::find(this->column_names.begin(), this->column_names.end(), column_name);
+    if (it == this->column_names.end())
+        throw DbRelationError("unknown column " + column_name);
+    return (uint) (it - this->column_names.begin());
+}
+
+// Copy of the row keyed by column name (freed by caller)
+ValueDict *Row::to_dict() const {
+    ValueDict *row = new ValueDict();
+    for (uint i = 0; i < size(); i++)
+        (*row)[this->schema->get_column_names()[i]] = this->values[i];
+    return row;
+}
+
+// Run the values' destructors (in case any was given TEXT of its own) and drop our arena, if any
+RowSet::~RowSet() {
+    for (auto &row: this->rows)
+        for (uint i = 0; i < row.size(); i++)
+            row[i].~Value();
+    delete this->own_arena;
+}
+
+// Append n rows of default values, their values all in one row-major array
+void RowSet::add(size_t n) {
+    uint width = this->schema.size();
+    Value *values = this->arena->make_array<Value>(n * width);
+    this->rows.reserve(this->rows.size() + n);
+    for (size_t i = 0; i < n; i++)
+        this->rows.emplace_back(&this->schema, values + i * width);
+}
+
+// Append a row given by column name (other keys are ignored)
+void RowSet::add(const ValueDict &row) {
+    Row &added = add();
+    for (uint i = 0; i < this->schema.size(); i++) {
+        auto it = row.find(this->schema.get_column_names()[i]);
+        if (it == row.end())
+            throw DbRelationError("row has no column " + this->schema.get_column_names()[i]);
+        added[i] = it->second;
+    }
+}
+
 // Get only selected column attributes
 ColumnAttributes *DbRelation::get_column_attributes(const ColumnNames &select_column_names) const {
+    std::vector<uint> col_nums = ordinals(select_column_names);
     ColumnAttributes *ret = new ColumnAttributes();
+    for (auto const &col_num: col_nums)
+        ret->push_back(this->column_attributes[col_num]);
+    return ret;
+}
+
+// Positions of the given columns in the relation
+std::vector<uint> DbRelation::ordinals(const ColumnNames &select_column_names) const {
+    std::vector<uint> ret;
     for (auto const &column_name: select_column_names) {
         auto it = std::find(this->column_names.begin(), this->column_names.end(), column_name);
-        if (it == this->column_names.end()) {
-            delete ret;
+        if (it == this->column_names.end())
             throw DbRelationError("unknown column " + column_name);
-        }
-        ptrdiff_t index = it - this->column_names.begin();
-        ret->push_back(this->column_attributes[index]);
+        ret.push_back((uint) (it - this->column_names.begin()));
     }
     return ret;
 }
 
+// Empty row set for the given columns (nullptr or empty for all of them)
+RowSet *DbRelation::new_row_set(const ColumnNames *column_names, Arena *arena) const {
+    if (column_names == nullptr || column_names->empty())
+        return new RowSet(this->column_names, this->column_attributes, arena);
+    ColumnAttributes *column_attributes = get_column_attributes(*column_names);
+    RowSet *rows = new RowSet(*column_names, *column_attributes, arena);
+    delete column_attributes;
+    return rows;
+}
+
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
 ValueDict *DbRelation::project(Handle handle, const ValueDict *where) {
     ColumnNames t;
@@ -71,19 +242,33 @@ ValueDict *DbRelation::project(Handle handle, const ValueDict *where) {
     return this->project(handle, &t);
 }
 
+// Insert each of a list of rows, taking them all out again if one fails
+Handles *DbRelation::insert_batch(const ValueDicts *rows) {
+    Handles *handles = new Handles();
+    try {
+        for (auto const &row: *rows)
+            handles->push_back(insert(row));
+    } catch (...) {
+        for (auto const &handle: *handles)
+            del(handle);
+        delete handles;
+        throw;
+    }
+    return handles;
+}
+
 // Do a projection for each of a list of handles
 ValueDicts *DbRelation::project(Handles *handles) {
-    ValueDicts *ret = new ValueDicts();
-    for (auto const &handle: *handles)
-        ret->push_back(project(handle));
-    return ret;
+    return project(handles, (const ColumnNames *) nullptr);
 }
 
-// Do a projection for each of a list of handles
+// Do a projection for each of a list of handles (as a batch, through project_rows())
 ValueDicts *DbRelation::project(Handles *handles, const ColumnNames *column_names) {
+    RowSet *rows = project_rows(handles, column_names);
     ValueDicts *ret = new ValueDicts();
-    for (auto const &handle: *handles)
-        ret->push_back(project(handle, column_names));
+    for (auto const &row: *rows)
+        ret->push_back(row.to_dict());
+    delete rows;
     return ret;
 }
 
@@ -92,9 +277,34 @@ ValueDicts *DbRelation::project(Handles *handles, const ValueDict *where) {
     ColumnNames t;
     for (auto const &column: *where)
         t.push_back(column.first);
-    ValueDicts *ret = new ValueDicts();
-    for (auto const &handle: *handles)
-        ret->push_back(project(handle, &t));
-    return ret;
+    return project(handles, &t);
 }
 
+// Do a projection for each of a list of handles, into positional rows
+RowSet *DbRelation::project_rows(Handles *handles, const ColumnNames *column_names, Arena *arena) {
+    RowSet *rows = new_row_set(column_names, arena);
+    try {
+        for (auto const &handle: *handles) {
+            ValueDict *row = project(handle, &rows->get_schema().get_column_names());
+            rows->add(*row);
+            delete row;
+        }
+    } catch (...) {
+        delete rows;
+        throw;
+    }
+    return rows;
+}
+
+// Insert the index entry for each of a list of records, taking them all out again if one fails
+void DbIndex::insert_batch(const Handles *records) {
+    size_t done = 0;
+    try {
+        for (; done < records->size(); done++)
+            insert((*records)[done]);
+    } catch (...) {
+        for (size_t i = 0; i < done; i++)
+            del((*records)[i]);
+        throw;
+    }
+}